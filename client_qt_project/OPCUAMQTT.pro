@@ -40,18 +40,50 @@ SOURCES += main.cpp\
         mainwindow.cpp \
     aboutdialog.cpp \
     opcuaclient.cpp \
-    coupleritem.cpp \
+    opcuanodemodel.cpp \
+    opcuasnapshot.cpp \
+    opcualinkstore.cpp \
+    opcualinkmatcher.cpp \
     mqttclient.cpp \
-    opcuaepwrapper.cpp
+    mqttconnection.cpp \
+    mqttwire.cpp \
+    mqttlatency.cpp \
+    opcuaepwrapper.cpp \
+    opcuasubpool.cpp \
+    opcuapoller.cpp \
+    opcuanoderegistry.cpp \
+    opcuabrowser.cpp \
+    opcuasubscription.cpp \
+    mqttqueue.cpp \
+    mqttpublisher.cpp \
+    mqttbatcher.cpp \
+    mqttcoalescer.cpp \
+    opcuavalueencoder.cpp
 
 HEADERS  += mainwindow.h \
     aboutdialog.h \
     config.h \
     opcuaclient.h \
-    coupleritem.h \
+    opcuanodemodel.h \
+    opcuasnapshot.h \
+    opcualinkstore.h \
+    opcualinkmatcher.h \
     mqttclient.h \
+    mqttconnection.h \
+    mqttwire.h \
+    mqttlatency.h \
     clientstates.h \
-    opcuaepwrapper.h
+    opcuaepwrapper.h \
+    opcuasubpool.h \
+    opcuapoller.h \
+    opcuanoderegistry.h \
+    opcuabrowser.h \
+    opcuasubscription.h \
+    mqttqueue.h \
+    mqttpublisher.h \
+    mqttbatcher.h \
+    mqttcoalescer.h \
+    opcuavalueencoder.h
 
 FORMS    += mainwindow.ui \
     aboutdialog.ui
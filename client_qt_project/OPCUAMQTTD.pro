@@ -0,0 +1,95 @@
+#-------------------------------------------------
+#
+# Headless gateway, no widgets
+#
+#-------------------------------------------------
+
+QT     += core
+QT     -= gui
+CONFIG += console
+CONFIG -= app_bundle
+
+# C++11
+QMAKE_CXXFLAGS += -std=c++11 -Werror=return-type
+
+# Optimization for release
+QMAKE_CXXFLAGS_RELEASE += -Ofast
+
+# Includes
+INCLUDEPATH += ./include # freeopcua, mqtt
+
+# Libraries
+win32 {
+    INCLUDEPATH += C:/boost/boost_mingw # boost
+
+    LIBS += -LC:/boost/boost_mingw/stage/lib \ # boost
+            -lws2_32 \ # winsock
+            -lboost_system-mgw49-mt-d-1_60 # boost system
+
+    LIBS += -L"$$PWD/lib/opcua" \ # freeopcua
+            -L"$$PWD/lib/mqtt" # mqtt
+}
+
+unix {
+    LIBS += -lboost_system \
+            -lboost_thread \
+            -lpthread
+}
+
+# io_uring send path for the native MQTT publisher: qmake CONFIG+=io_uring
+unix:io_uring {
+    DEFINES += MQTT_USE_IO_URING
+    LIBS += -luring
+}
+
+LIBS += -lopcuacore \ # freeopcua
+        -lopcuaprotocol \
+        -lopcuaclient \
+        -lmosquitto \ # mqtt
+        -lmosquittopp
+
+TARGET = opcuamqttd
+TEMPLATE = app
+
+SOURCES += daemonmain.cpp \
+    gatewaydaemon.cpp \
+    gatewaysession.cpp \
+    opcuaclient.cpp \
+    opcualinkstore.cpp \
+    opcualinkmatcher.cpp \
+    mqttclient.cpp \
+    mqttconnection.cpp \
+    mqttwire.cpp \
+    mqttlatency.cpp \
+    opcuasubpool.cpp \
+    opcuapoller.cpp \
+    opcuabrowser.cpp \
+    opcuanoderegistry.cpp \
+    opcuasubscription.cpp \
+    mqttqueue.cpp \
+    mqttpublisher.cpp \
+    mqttbatcher.cpp \
+    mqttcoalescer.cpp \
+    opcuavalueencoder.cpp
+
+HEADERS += gatewaydaemon.h \
+    gatewaysession.h \
+    config.h \
+    opcuaclient.h \
+    opcualinkstore.h \
+    opcualinkmatcher.h \
+    mqttclient.h \
+    mqttconnection.h \
+    mqttwire.h \
+    mqttlatency.h \
+    clientstates.h \
+    opcuasubpool.h \
+    opcuapoller.h \
+    opcuabrowser.h \
+    opcuanoderegistry.h \
+    opcuasubscription.h \
+    mqttqueue.h \
+    mqttpublisher.h \
+    mqttbatcher.h \
+    mqttcoalescer.h \
+    opcuavalueencoder.h
@@ -6,4 +6,61 @@
 #define VERSION_A 2
 #define VERSION_S "Version " << VERSION_R << "." << VERSION_B << "." << VERSION_A
 
+// OPC UA subscription pool, max monitored items per server subscription
+#define OPCUA_SUB_MAX_ITEMS 1000
+
+// Default link publishing interval in ms and monitored item queue size
+#define OPCUA_LINK_PERIOD 60
+#define OPCUA_LINK_QUEUE_SIZE 1
+
+// Polled links, max nodes read with one ReadAttributes call
+#define OPCUA_POLL_GROUP_SIZE 100
+
+// Address space browser, worker threads, nodes per Browse request & max depth
+#define OPCUA_BROWSE_WORKERS 4
+#define OPCUA_BROWSE_NODES_PER_CALL 50
+#define OPCUA_BROWSE_MAX_DEPTH 64
+
+// Monitored items per CreateMonitoredItems call, if the server doesn't limit it
+#define OPCUA_MAX_ITEMS_PER_CALL 1000
+
+// MQTT outbound queue, slot count (power of two) and max sizes of a message
+#define MQTT_QUEUE_SIZE 4096
+#define MQTT_MSG_TOPIC_MAX 256
+#define MQTT_MSG_PAYLOAD_MAX 1024
+
+// MQTT frame batching, max payload of a frame (at most MQTT_MSG_PAYLOAD_MAX)
+#define MQTT_BATCH_PAYLOAD_MAX MQTT_MSG_PAYLOAD_MAX
+
+// MQTT broker connections, topics are spread over them by hash
+#define MQTT_CONNECTIONS 1
+
+// MQTT publisher thread, max messages published per wakeup
+#define MQTT_PUBLISH_BATCH 64
+
+// MQTT network loop, epoll on Linux (mosquitto_loop elsewhere), max wait in ms
+// between keepalive checks and delay between reconnect attempts
+#if defined(__linux__)
+#define MQTT_USE_EPOLL
+#endif
+#define MQTT_LOOP_TIMEOUT 1000
+#define MQTT_RECONNECT_DELAY 1000
+
+// MQTT native publisher (MQTT_USE_EPOLL only), send buffer ring of a connection,
+// buffer count and size (at least one full PUBLISH packet), max wait in ms for
+// the TCP connect to the broker
+#define MQTT_WIRE_BUFFERS 8
+#define MQTT_WIRE_BUFFER_SIZE 65536
+#define MQTT_WIRE_CONNECT_TIMEOUT 5000
+
+// MQTT native publisher io_uring send path, built with CONFIG+=io_uring (needs
+// liburing), sendmsg is used when the kernel has no io_uring. Ring entries
+#if defined(MQTT_USE_IO_URING) && !defined(MQTT_USE_EPOLL)
+#undef MQTT_USE_IO_URING
+#endif
+#define MQTT_URING_ENTRIES 32
+
+// MQTT unacknowledged QoS 1 publishes, beyond this changes are coalesced per topic
+#define MQTT_INFLIGHT_WINDOW 100
+
 #endif // CONFIG_H
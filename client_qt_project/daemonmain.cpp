@@ -0,0 +1,43 @@
+#include "gatewaydaemon.h"
+#include <QCoreApplication>
+#include <QStringList>
+#include <QTimer>
+#include <csignal>
+
+namespace
+{
+
+volatile std::sig_atomic_t s_quit = 0;
+
+void onSignal(int)
+{
+    s_quit = 1;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QStringList args = a.arguments();
+    GatewayDaemon gateway(args.size() > 1 ? args.at(1) : QString("gateway.ini"));
+    if (!gateway.loadConfig())
+        return 1;
+
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+
+    // Signals only set the flag, the event loop is left from here
+    QTimer quit;
+    QObject::connect(&quit, &QTimer::timeout, [&a]() {
+        if (s_quit)
+            a.quit();
+    });
+    quit.start(200);
+
+    gateway.start();
+    int rc = a.exec();
+    gateway.stop();
+    return rc;
+}
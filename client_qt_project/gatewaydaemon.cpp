@@ -0,0 +1,187 @@
+#include "gatewaydaemon.h"
+#include "mqttbatcher.h"
+#include "config.h"
+#include <QDebug>
+#include <QFile>
+#include <QSettings>
+
+// --------------------------------------------------------
+// Headless gateway class below
+// --------------------------------------------------------
+GatewayDaemon::GatewayDaemon(const QString &configfile, QObject *parent) :
+    QObject(parent),
+    m_configfile(configfile),
+    m_mqtt_host(std::string("localhost")),
+    m_mqtt_port(1883),
+    m_mqtt_topic(std::string("opcuamqtt")),
+    m_mqtt_json(false),
+    m_mqtt_batch(false),
+    m_mqtt_batchwindow(0),
+    m_mqtt_connections(MQTT_CONNECTIONS),
+    m_mqtt_native(false),
+    m_retry(5),
+    m_configs(std::vector<SessionConfig>()),
+    m_mqtt_client(nullptr),
+    m_sessions(std::vector<GatewaySession *>()),
+    m_timer(new QTimer(this)),
+    m_mqtt_wait(0)
+{
+    connect(m_timer, SIGNAL(timeout()),
+            this, SLOT(supervise()));
+}
+
+GatewayDaemon::~GatewayDaemon()
+{
+    stop();
+
+    // The sessions publish through the MQTT client, they go first
+    for (GatewaySession *session : m_sessions)
+        delete session;
+
+    if (m_mqtt_client)
+        delete m_mqtt_client;
+}
+
+bool GatewayDaemon::loadConfig()
+{
+    if (!QFile::exists(m_configfile))
+    {
+        qDebug() << "Gateway: Config file" << m_configfile << "not found.";
+        return false;
+    }
+
+    QSettings settings(m_configfile, QSettings::IniFormat);
+
+    m_retry = settings.value("OpcUa/RetrySeconds", 5).toInt();
+    m_mqtt_host = settings.value("Mqtt/Host", QString::fromStdString(m_mqtt_host)).toString().toStdString();
+    m_mqtt_port = settings.value("Mqtt/Port", 1883).toInt();
+    m_mqtt_topic = settings.value("Mqtt/Topic", QString::fromStdString(m_mqtt_topic)).toString().toStdString();
+    m_mqtt_json = settings.value("Mqtt/PayloadJson", false).toBool();
+    m_mqtt_batch = settings.value("Mqtt/Batch", false).toBool();
+    m_mqtt_batchwindow = settings.value("Mqtt/BatchWindow", 0).toInt();
+    m_mqtt_connections = settings.value("Mqtt/Connections", MQTT_CONNECTIONS).toInt();
+    m_mqtt_native = settings.value("Mqtt/Native", false).toBool();
+
+    m_configs.clear();
+    unsigned int maxitems = settings.value("OpcUa/MaxItemsPerSub", OPCUA_SUB_MAX_ITEMS).toUInt();
+
+    // Several servers, each with its own name, endpoint & link file
+    int count = settings.beginReadArray("Sessions");
+    for (int i = 0; i < count; i++)
+    {
+        settings.setArrayIndex(i);
+
+        SessionConfig config;
+        config.name = settings.value("Name", QString("session%1").arg(i + 1)).toString().toStdString();
+        config.endpoint = settings.value("Endpoint").toString().toStdString();
+        config.maxitems = settings.value("MaxItemsPerSub", maxitems).toUInt();
+
+        QString linksfile = settings.value("LinksFile").toString();
+        if (!linksfile.isEmpty())
+        {
+            QSettings links(linksfile, QSettings::IniFormat);
+            loadLinks(links, config);
+        }
+
+        m_configs.push_back(config);
+    }
+    settings.endArray();
+
+    // Or the single server of the [OpcUa] group, links in this file
+    if (m_configs.empty())
+    {
+        SessionConfig config;
+        config.endpoint = settings.value("OpcUa/Endpoint", "opc.tcp://localhost:4840/").toString().toStdString();
+        config.maxitems = maxitems;
+        loadLinks(settings, config);
+
+        // Links saved by the GUI for a server can be used as they are
+        QString linksfile = settings.value("OpcUa/LinksFile").toString();
+        if (!linksfile.isEmpty())
+        {
+            QSettings links(linksfile, QSettings::IniFormat);
+            loadLinks(links, config);
+        }
+
+        m_configs.push_back(config);
+    }
+
+    for (const SessionConfig &config : m_configs)
+    {
+        if (config.endpoint.empty())
+        {
+            qDebug() << "Gateway: Session" << config.name.c_str() << "has no endpoint.";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void GatewayDaemon::start()
+{
+    m_mqtt_client = new MQTTClient(m_mqtt_host, m_mqtt_port, 0, m_mqtt_topic, m_mqtt_connections, m_mqtt_native);
+    m_mqtt_client->getBatcher()->setWindow(m_mqtt_batchwindow);
+    m_mqtt_client->getBatcher()->setEnabled(m_mqtt_batch);
+
+    // Named sessions publish under their own subtopic, servers often share browse names
+    for (const SessionConfig &config : m_configs)
+    {
+        GatewaySession *session = new GatewaySession(config.name.empty() ? config.endpoint : config.name, config.endpoint, m_mqtt_client);
+        OPCUAClient *client = session->getClient();
+
+        client->setMaxItemsPerSub(config.maxitems);
+        client->getSubClient()->setTopic(config.name.empty() ? m_mqtt_topic : m_mqtt_topic + "/" + config.name);
+        client->getSubClient()->setPayloadMode(m_mqtt_json ? PAYLOAD_JSON : PAYLOAD_VALUE);
+        session->setLinks(config.sets, config.rules);
+        session->setRetry(m_retry);
+
+        m_sessions.push_back(session);
+    }
+
+    startMqtt();
+
+    for (GatewaySession *session : m_sessions)
+        session->start();
+
+    m_timer->start(1000);
+}
+
+void GatewayDaemon::stop()
+{
+    m_timer->stop();
+
+    for (GatewaySession *session : m_sessions)
+        session->stop();
+
+    if (m_mqtt_client && m_mqtt_client->isRunning())
+    {
+        m_mqtt_client->setRunState(STOPPED);
+        m_mqtt_client->wait();
+    }
+}
+
+void GatewayDaemon::supervise()
+{
+    // The MQTT client retries on its own first, the thread ending means it gave up
+    if (!m_mqtt_client->isRunning() && --m_mqtt_wait <= 0)
+        startMqtt();
+
+    for (GatewaySession *session : m_sessions)
+        session->supervise();
+}
+
+void GatewayDaemon::startMqtt()
+{
+    m_mqtt_wait = m_retry;
+    m_mqtt_client->start();
+}
+
+void GatewayDaemon::loadLinks(QSettings &settings, SessionConfig &config)
+{
+    std::vector<OPCUALinkSet> sets = OPCUALinkStore::load(settings);
+    std::vector<OPCUALinkRule> rules = OPCUALinkStore::loadRules(settings);
+
+    config.sets.insert(config.sets.end(), sets.begin(), sets.end());
+    config.rules.insert(config.rules.end(), rules.begin(), rules.end());
+}
@@ -0,0 +1,66 @@
+#ifndef GATEWAYDAEMON_H
+#define GATEWAYDAEMON_H
+
+#include <QObject>
+#include <QTimer>
+#include <QString>
+#include <string>
+#include <vector>
+#include "gatewaysession.h"
+#include "mqttclient.h"
+
+// --------------------------------------------------------
+// GatewayDaemon class, runs the gateway without a GUI
+// Reads the broker & one or more OPC UA sessions from an INI file. All
+// sessions publish through one MQTT client, so one broker connection and
+// one publisher pipeline serve every server. A supervision timer restarts
+// the MQTT client when its thread has ended & lets each session reconnect
+// and link its sets again on its own.
+// --------------------------------------------------------
+class GatewayDaemon : public QObject
+{
+    Q_OBJECT
+
+public:
+    GatewayDaemon(const QString &configfile, QObject *parent = nullptr);
+    ~GatewayDaemon();
+
+    bool loadConfig();
+    void start();
+    void stop();
+
+public slots:
+    void supervise();
+
+private:
+    struct SessionConfig
+    {
+        std::string name;
+        std::string endpoint;
+        unsigned int maxitems;
+        std::vector<OPCUALinkSet> sets;
+        std::vector<OPCUALinkRule> rules;
+    };
+
+    void startMqtt();
+    static void loadLinks(QSettings &settings, SessionConfig &config);
+
+    QString m_configfile;
+    std::string m_mqtt_host;
+    int m_mqtt_port;
+    std::string m_mqtt_topic;
+    bool m_mqtt_json;
+    bool m_mqtt_batch;
+    int m_mqtt_batchwindow;
+    int m_mqtt_connections;
+    bool m_mqtt_native;
+    int m_retry;
+    std::vector<SessionConfig> m_configs;
+    MQTTClient *m_mqtt_client;
+    std::vector<GatewaySession *> m_sessions;
+    QTimer *m_timer;
+    int m_mqtt_wait;
+
+};
+
+#endif // GATEWAYDAEMON_H
@@ -0,0 +1,174 @@
+#include "gatewaysession.h"
+#include "mqttclient.h"
+#include "config.h"
+#include <QDebug>
+#include <opc/ua/protocol/string_utils.h>
+
+// --------------------------------------------------------
+// Gateway session class below
+// --------------------------------------------------------
+GatewaySession::GatewaySession(const std::string &name, const std::string &endpoint, MQTTClient *mqtt, QObject *parent) :
+    QObject(parent),
+    m_name(name),
+    m_endpoint(endpoint),
+    m_client(new OPCUAClient(mqtt, endpoint)),
+    m_browser(nullptr),
+    m_linksets(std::vector<OPCUALinkSet>()),
+    m_matcher(OPCUALinkMatcher()),
+    m_retry(5),
+    m_wait(0),
+    m_linked(false)
+{
+    m_browser = new OPCUABrowser(m_client->getClient(), OPCUA_BROWSE_WORKERS, OPCUA_BROWSE_NODES_PER_CALL, OPCUA_BROWSE_MAX_DEPTH);
+
+    connect(m_browser, SIGNAL(nodesBrowsed(std::vector<OPCUABrowseNode>)),
+            this, SLOT(rulesBrowsed(std::vector<OPCUABrowseNode>)));
+}
+
+GatewaySession::~GatewaySession()
+{
+    stop();
+
+    if (m_browser)
+        delete m_browser;
+
+    if (m_client)
+        delete m_client;
+}
+
+void GatewaySession::setLinks(const std::vector<OPCUALinkSet> &sets, const std::vector<OPCUALinkRule> &rules)
+{
+    m_linksets = sets;
+    m_matcher.setRules(rules);
+
+    size_t nodes = 0;
+    for (const OPCUALinkSet &set : m_linksets)
+        nodes += set.nodes.size();
+
+    qDebug() << "Gateway:" << m_name.c_str() << "has" << (unsigned long long) m_linksets.size() << "link sets with"
+             << (unsigned long long) nodes << "nodes &" << (unsigned long long) rules.size() << "link rules.";
+}
+
+void GatewaySession::setRetry(int retry)
+{
+    m_retry = retry;
+}
+
+void GatewaySession::start()
+{
+    connectClient();
+}
+
+void GatewaySession::stop()
+{
+    // A browse still running would use the session being closed
+    m_browser->stop();
+    m_browser->wait();
+
+    if (m_client->isRunning())
+    {
+        m_client->setRunState(STOPPED);
+        m_client->wait();
+    }
+}
+
+void GatewaySession::supervise()
+{
+    if (m_client->isRunning())
+    {
+        // The poller is started last, the session is fully set up by then
+        if (!m_linked && m_client->getStatus() == CONNECTED && m_client->getPoller()->isRunning())
+        {
+            linkAll();
+            m_linked = true;
+        }
+    }
+    else
+    {
+        if (m_linked)
+            m_browser->stop();
+
+        m_linked = false;
+
+        if (--m_wait <= 0)
+            connectClient();
+    }
+}
+
+std::string GatewaySession::getName() const
+{
+    return m_name;
+}
+
+OPCUAClient *GatewaySession::getClient() const
+{
+    return m_client;
+}
+
+void GatewaySession::rulesBrowsed(const std::vector<OPCUABrowseNode> &nodes)
+{
+    if (m_client->getStatus() != CONNECTED)
+        return;
+
+    linkSets(m_matcher.add(nodes), "rule match");
+}
+
+void GatewaySession::connectClient()
+{
+    m_wait = m_retry;
+
+    // No target endpoint, the client picks one without security itself
+    m_client->setInitEndpoint(m_endpoint);
+    m_client->setTargetEndpoint(OpcUa::EndpointDescription());
+    m_client->start();
+}
+
+void GatewaySession::linkAll()
+{
+    linkSets(m_linksets, "link set");
+
+    // Rules need the address space, it's browsed once per session & matched as it streams in
+    if (!m_matcher.getRules().empty())
+    {
+        m_matcher.clear();
+        m_browser->browse(*m_client->getObjectsNode(), OPCUA_BROWSE_MAX_DEPTH);
+    }
+}
+
+void GatewaySession::linkSets(const std::vector<OPCUALinkSet> &sets, const char *what)
+{
+    OpcUa::UaClient *client = m_client->getClient();
+
+    for (size_t i = 0; i < sets.size(); i++)
+    {
+        const OPCUALinkSet &set = sets[i];
+
+        std::vector<OpcUa::Node> nodes;
+        nodes.reserve(set.nodes.size());
+        for (const OpcUa::NodeId &id : set.nodes)
+            nodes.push_back(client->GetNode(id));
+
+        try
+        {
+            std::vector<OPCUALinkResult> results = m_client->createOpcUaMqttLinks(nodes, set.options);
+
+            size_t failed = 0;
+            for (size_t j = 0; j < results.size(); j++)
+            {
+                if (results[j].status == OpcUa::StatusCode::Good)
+                    continue;
+
+                if (failed < 10)
+                    qDebug() << "Gateway:" << m_name.c_str() << "link failed" << nodes[j].ToString().c_str() << OpcUa::ToString(results[j].status).c_str();
+
+                failed++;
+            }
+
+            qDebug() << "Gateway:" << m_name.c_str() << what << i + 1 << "linked" << (unsigned long long) (results.size() - failed) << "/" << (unsigned long long) results.size() << "nodes.";
+        }
+        catch (const std::exception &e)
+        {
+            qDebug() << "Gateway:" << m_name.c_str() << what << i + 1 << "failed:" << e.what();
+        }
+    }
+}
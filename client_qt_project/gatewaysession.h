@@ -0,0 +1,58 @@
+#ifndef GATEWAYSESSION_H
+#define GATEWAYSESSION_H
+
+#include <QObject>
+#include <string>
+#include <vector>
+#include "opcuaclient.h"
+#include "opcuabrowser.h"
+#include "opcualinkstore.h"
+#include "opcualinkmatcher.h"
+
+class MQTTClient;
+
+// --------------------------------------------------------
+// GatewaySession class, one OPC UA server of the headless gateway
+// Owns the OPC UA client (its own thread, subscriptions & poller) and
+// publishes through the shared MQTT client. The endpoint is resolved on
+// the client thread, so a server that's down never blocks the others.
+// supervise() is called by the daemon once a second, it links the sets
+// on every new session & starts the client again when its thread ended.
+// --------------------------------------------------------
+class GatewaySession : public QObject
+{
+    Q_OBJECT
+
+public:
+    GatewaySession(const std::string &name, const std::string &endpoint, MQTTClient *mqtt, QObject *parent = nullptr);
+    ~GatewaySession();
+
+    void setLinks(const std::vector<OPCUALinkSet> &sets, const std::vector<OPCUALinkRule> &rules);
+    void setRetry(int retry);
+    void start();
+    void stop();
+    void supervise();
+    std::string getName() const;
+    OPCUAClient *getClient() const;
+
+public slots:
+    void rulesBrowsed(const std::vector<OPCUABrowseNode> &nodes);
+
+private:
+    void connectClient();
+    void linkAll();
+    void linkSets(const std::vector<OPCUALinkSet> &sets, const char *what);
+
+    std::string m_name;
+    std::string m_endpoint;
+    OPCUAClient *m_client;
+    OPCUABrowser *m_browser;
+    std::vector<OPCUALinkSet> m_linksets;
+    OPCUALinkMatcher m_matcher;
+    int m_retry;
+    int m_wait;
+    bool m_linked;
+
+};
+
+#endif // GATEWAYSESSION_H
@@ -2,12 +2,20 @@
 #include "ui_mainwindow.h"
 #include "aboutdialog.h"
 #include "ui_aboutdialog.h"
-#include "coupleritem.h"
 #include "opcuaepwrapper.h"
+#include "config.h"
+#include "opcuavalueencoder.h"
+#include "mqttbatcher.h"
+#include "opcuasnapshot.h"
 #include <QDebug>
 #include <QInputDialog>
 #include <QMessageBox>
 #include <QSettings>
+#include <QScrollBar>
+#include <QStandardPaths>
+#include <QDir>
+#include <QCryptographicHash>
+#include <opc/ua/protocol/string_utils.h>
 
 // --------------------------------------------------------
 // MainWindow class below
@@ -19,7 +27,22 @@ MainWindow::MainWindow(QWidget *parent) :
     m_settingsFile(QApplication::applicationDirPath().left(1) + ":/settings.ini"),
     m_opcua_addr(std::string("")),
     m_mqtt_addr(std::string("")),
+    m_opcua_maxitems(OPCUA_SUB_MAX_ITEMS),
+    m_mqtt_batchwindow(0),
+    m_mqtt_connections(MQTT_CONNECTIONS),
+    m_mqtt_native(false),
     m_opcua_client(nullptr),
+    m_opcua_browser(nullptr),
+    m_tree_model(new OPCUANodeModel(this)),
+    m_tree_timer(new QTimer(this)),
+    m_tree_browsed(std::vector<OPCUABrowseNode>()),
+    m_tree_snapshot(false),
+    m_tree_snapshoturi(std::string("")),
+    m_tree_snapshotfile(std::string("")),
+    m_links(std::map<std::string, OPCUALinkOptions>()),
+    m_link_handles(std::unordered_map<std::string, uint32_t>()),
+    m_links_file(std::string("")),
+    m_link_matcher(OPCUALinkMatcher()),
     m_mqtt_client(nullptr)
 {
     // Basic UI setup
@@ -27,26 +50,30 @@ MainWindow::MainWindow(QWidget *parent) :
     setWindowTitle("OPC UA -> MQTT Gateway client");
     setWindowIcon(QIcon(":/res/icon.ico"));
 
-    qRegisterMetaType<CouplerItem>("CouplerItem");
-    qRegisterMetaType<CouplerItem *>("CouplerItem *");
     qRegisterMetaType<OPCUAEpWrapper>("OPCUAEpWrapper");
     qRegisterMetaType<OPCUAEpWrapper *>("OPCUAEpWrapper *");
 
+    m_ui->tv_opcua->setModel(m_tree_model);
     m_ui->tv_opcua->setIndentation(16);
     m_ui->tv_opcua->setDragEnabled(false);
-    m_ui->tv_opcua->setColumnCount(3);
-    m_ui->tv_opcua->setHeaderLabels(QStringList() << "NdIdx" << "NsIdx" << "Name" << "Value");
+    m_ui->tv_opcua->setUniformRowHeights(true);
     m_ui->tv_opcua->resizeColumnToContents(3);
     m_ui->tv_opcua->setContextMenuPolicy(Qt::CustomContextMenu);
+    m_tree_timer->setSingleShot(true);
+    m_tree_timer->setInterval(200);
 
     // Load GUI settings from ini file
     loadSettings();
 
     // Initialize opc ua / mqtt clients
     setMqttStatus(DISCONNECTED);
-    m_mqtt_client = new MQTTClient("localhost", 1883, 0, "opcuamqtt");
+    m_mqtt_client = new MQTTClient("localhost", 1883, 0, "opcuamqtt", m_mqtt_connections, m_mqtt_native);
     setOpcUaStatus(DISCONNECTED);
     m_opcua_client = new OPCUAClient(m_mqtt_client);
+    m_opcua_client->setMaxItemsPerSub(m_opcua_maxitems);
+    m_opcua_browser = new OPCUABrowser(m_opcua_client->getClient(), OPCUA_BROWSE_WORKERS, OPCUA_BROWSE_NODES_PER_CALL, OPCUA_BROWSE_MAX_DEPTH);
+    setMqttPayloadMode(m_ui->cb_mqtt_json->isChecked());
+    setMqttBatching(m_ui->cb_mqtt_batch->isChecked());
 
     // Signal -> Slot connections
     connect(m_ui->actionExit, SIGNAL(triggered(bool)),
@@ -63,12 +90,32 @@ MainWindow::MainWindow(QWidget *parent) :
             this, SLOT(initOpcUaClient()));
     connect(m_ui->pb_mqtt_init, SIGNAL(clicked(bool)),
             this, SLOT(initMqttClient()));
-    connect(m_ui->tv_opcua, SIGNAL(itemClicked(QTreeWidgetItem*, int)),
-            this, SLOT(treeUpdateItem(QTreeWidgetItem*, int)));
+    connect(m_ui->tv_opcua, SIGNAL(clicked(QModelIndex)),
+            this, SLOT(treeUpdateItem(QModelIndex)));
+    connect(m_tree_model, SIGNAL(childrenRequested(QModelIndex)),
+            this, SLOT(treeFetchChildren(QModelIndex)));
+    connect(m_tree_model, SIGNAL(rowsInserted(QModelIndex, int, int)),
+            this, SLOT(treeScheduleRead()));
+    connect(m_ui->tv_opcua, SIGNAL(expanded(QModelIndex)),
+            this, SLOT(treeScheduleRead()));
+    connect(m_ui->tv_opcua->verticalScrollBar(), SIGNAL(valueChanged(int)),
+            this, SLOT(treeScheduleRead()));
+    connect(m_tree_timer, SIGNAL(timeout()),
+            this, SLOT(treeReadVisible()));
     connect(m_ui->tv_opcua, SIGNAL(customContextMenuRequested(QPoint)),
             this, SLOT(showOpcUaVarMenu(QPoint)));
     connect(m_ui->le_mqtt_topic, SIGNAL(editingFinished()),
             this, SLOT(setMqttTopic()));
+    connect(m_ui->cb_mqtt_json, SIGNAL(toggled(bool)),
+            this, SLOT(setMqttPayloadMode(bool)));
+    connect(m_ui->cb_mqtt_batch, SIGNAL(toggled(bool)),
+            this, SLOT(setMqttBatching(bool)));
+    connect(m_opcua_browser, SIGNAL(nodesBrowsed(std::vector<OPCUABrowseNode>)),
+            this, SLOT(treeAddBrowsedNodes(std::vector<OPCUABrowseNode>)));
+    connect(m_opcua_browser, SIGNAL(browseProgress(quint64, quint64, double)),
+            this, SLOT(browseProgress(quint64, quint64, double)));
+    connect(m_opcua_browser, SIGNAL(browseFinished(quint64, double, bool)),
+            this, SLOT(browseFinished(quint64, double, bool)));
 
     // Make sure MainWindow is destroyed upon close
     setAttribute(Qt::WA_QuitOnClose);
@@ -82,6 +129,9 @@ MainWindow::~MainWindow()
     if (m_about)
         delete m_about;
 
+    if (m_opcua_browser)
+        delete m_opcua_browser;
+
     if (m_opcua_client)
     {
         if (m_opcua_client->getRunState() == RUNNING)
@@ -125,11 +175,21 @@ void MainWindow::saveSettings()
     QString s_mqtt_addr = (m_ui->le_mqtt_addr) ? m_ui->le_mqtt_addr->text() : "";
     QString s_mqtt_port = (m_ui->le_mqtt_port) ? m_ui->le_mqtt_port->text() : "1883";
     QString s_mqtt_topic = (m_ui->le_mqtt_topic) ? m_ui->le_mqtt_topic->text() : "opcuamqtt";
+    bool s_mqtt_json = (m_ui->cb_mqtt_json) ? m_ui->cb_mqtt_json->isChecked() : false;
+    bool s_mqtt_batch = (m_ui->cb_mqtt_batch) ? m_ui->cb_mqtt_batch->isChecked() : false;
+    bool s_opcua_lazy = (m_ui->cb_opcua_lazy) ? m_ui->cb_opcua_lazy->isChecked() : false;
 
     settings.setValue("OpcUaInitAddr", s_opcua_addr);
     settings.setValue("MqttAddr", s_mqtt_addr);
     settings.setValue("MqttPort", s_mqtt_port);
     settings.setValue("MqttTopic", s_mqtt_topic);
+    settings.setValue("MqttPayloadJson", s_mqtt_json);
+    settings.setValue("MqttBatch", s_mqtt_batch);
+    settings.setValue("MqttBatchWindow", m_mqtt_batchwindow);
+    settings.setValue("MqttConnections", m_mqtt_connections);
+    settings.setValue("MqttNative", m_mqtt_native);
+    settings.setValue("OpcUaMaxItemsPerSub", m_opcua_maxitems);
+    settings.setValue("OpcUaLazyTree", s_opcua_lazy);
 
     m_ui->le_opcua_addr->setText(s_opcua_addr);
     m_ui->le_mqtt_addr->setText(s_mqtt_addr);
@@ -147,43 +207,56 @@ void MainWindow::loadSettings()
     QString s_mqtt_addr = settings.value("MqttAddr", "").toString();
     QString s_mqtt_port = settings.value("MqttPort", "1883").toString();
     QString s_mqtt_topic = settings.value("MqttTopic", "opcuamqtt").toString();
+    bool s_mqtt_json = settings.value("MqttPayloadJson", false).toBool();
+    bool s_mqtt_batch = settings.value("MqttBatch", false).toBool();
+    bool s_opcua_lazy = settings.value("OpcUaLazyTree", false).toBool();
+    m_mqtt_batchwindow = settings.value("MqttBatchWindow", 0).toInt();
+    m_mqtt_connections = settings.value("MqttConnections", MQTT_CONNECTIONS).toInt(); // Used on the next app start
+    m_mqtt_native = settings.value("MqttNative", false).toBool(); // Used on the next app start
+    m_opcua_maxitems = settings.value("OpcUaMaxItemsPerSub", OPCUA_SUB_MAX_ITEMS).toUInt();
 
     m_ui->le_opcua_addr->setText(s_opcua_addr);
     m_ui->le_mqtt_addr->setText(s_mqtt_addr);
     m_ui->le_mqtt_port->setText(s_mqtt_port);
     m_ui->le_mqtt_topic->setText(s_mqtt_topic);
+    m_ui->cb_mqtt_json->setChecked(s_mqtt_json);
+    m_ui->cb_mqtt_batch->setChecked(s_mqtt_batch);
+    m_ui->cb_opcua_lazy->setChecked(s_opcua_lazy);
+
+    if (m_opcua_client)
+        m_opcua_client->setMaxItemsPerSub(m_opcua_maxitems);
+
+    setMqttBatching(s_mqtt_batch);
 
     qDebug() << "Settings loaded from" << settings.fileName();
 }
 
-void MainWindow::createOpcUaMqttLink(QTreeWidgetItem *item)
+void MainWindow::createOpcUaMqttLink(const QModelIndex &index, const OPCUALinkOptions &options)
 {
     // Return immediately if OpcUa/MQTT client is not running
     if (m_opcua_client->getStatus() != CONNECTED || m_mqtt_client->getStatus() != CONNECTED)
         return;
 
-    // Get the node by casting the QVariant data in column 0 into CouplerItem*
-    CouplerItem *item_coupler = item->data(0, Qt::UserRole).value<CouplerItem *>();
-    OpcUa::Node node_opcua = item_coupler->getOpcUaNode();
-
-    // If the data was invalid, return immediately with error.
-    if (!item_coupler)
-    {
-        qDebug() << "Critical error! Couldn't convert tree node from QVariant to CouplerItem*";
-        return;
-    }
-
     // If the subscription exists, leave
-    if (item_coupler->getSubHandle() != 0)
+    if (m_tree_model->getHandle(index) != 0)
     {
         QMessageBox::warning(this, "Subscription already found", "There was an alive subscription found for this node. Link failed.");
         return;
     }
 
-    // Add a subscription, later add option for user to set sub time + other stuff.
+    // Add a subscription, pooled by the publishing interval in options
     try
     {
-        m_opcua_client->createOpcUaMqttLink(item_coupler, 60);
+        uint32_t handle = m_opcua_client->createOpcUaMqttLink(treeNode(index), options);
+        m_tree_model->setHandle(index, handle);
+        if (handle == 0)
+            return;
+
+        // Kept with its options, restored on the next connect
+        std::string key = OpcUa::ToString(m_tree_model->getNodeId(index));
+        m_links[key] = options;
+        m_link_handles[key] = handle;
+        saveLinks();
     }
     catch (const std::exception &e)
     {
@@ -194,34 +267,62 @@ void MainWindow::createOpcUaMqttLink(QTreeWidgetItem *item)
     }
 }
 
-void MainWindow::removeOpcUaMqttLink(QTreeWidgetItem *item)
+void MainWindow::createOpcUaMqttLinks(const QModelIndex &index, const OPCUALinkOptions &options)
 {
     // Return immediately if OpcUa/MQTT client is not running
     if (m_opcua_client->getStatus() != CONNECTED || m_mqtt_client->getStatus() != CONNECTED)
         return;
 
-    // Get the node by casting the QVariant data in column 0 into CouplerItem*
-    CouplerItem *item_coupler = item->data(0, Qt::UserRole).value<CouplerItem *>();
-    OpcUa::Node node_opcua = item_coupler->getOpcUaNode();
-
-    // If the data was invalid, return immediately with error.
-    if (!item_coupler)
+    // Gather all child nodes that aren't linked yet
+    std::vector<QModelIndex> children;
+    std::vector<OpcUa::Node> nodes;
+    for (int i = 0; i < m_tree_model->rowCount(index); i++)
     {
-        qDebug() << "Critical error! Couldn't convert tree node from QVariant to CouplerItem*";
-        return;
+        QModelIndex child = m_tree_model->index(i, 0, index);
+
+        if (m_tree_model->getHandle(child) == 0)
+        {
+            children.push_back(child);
+            nodes.push_back(treeNode(child));
+        }
     }
 
-    // If the subscription doesn't exist, leave
-    if (item_coupler->getSubHandle() == 0)
-    {
-        QMessageBox::warning(this, "Subscription not found", "There was no subscription found for this node. Unlink failed.");
+    if (nodes.empty())
         return;
-    }
 
-    // Remove the subscription
+    // Link them all in one go with the same options
     try
     {
-        m_opcua_client->removeOpcUaMqttLink(item_coupler);
+        std::vector<OPCUALinkResult> results = m_opcua_client->createOpcUaMqttLinks(nodes, options);
+
+        // Report the items the server refused
+        int failed = 0;
+        std::string failures;
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            m_tree_model->setHandle(children[i], results[i].handle);
+
+            if (results[i].status != OpcUa::StatusCode::Good)
+            {
+                if (failed < 10)
+                    failures.append(nodes[i].ToString() + ": " + OpcUa::ToString(results[i].status) + "\n");
+
+                failed++;
+                continue;
+            }
+
+            std::string key = OpcUa::ToString(m_tree_model->getNodeId(children[i]));
+            m_links[key] = options;
+            m_link_handles[key] = results[i].handle;
+        }
+
+        if (failed < static_cast<int>(results.size()))
+            saveLinks();
+
+        m_ui->statusBar->showMessage("Linked " + QString::number(results.size() - failed) + "/" + QString::number(results.size()) + " child nodes.", 5000);
+
+        if (failed > 0)
+            QMessageBox::warning(this, "Link failed", QString::number(failed) + " nodes could not be linked.\n" + QString::fromStdString(failures));
     }
     catch (const std::exception &e)
     {
@@ -232,60 +333,119 @@ void MainWindow::removeOpcUaMqttLink(QTreeWidgetItem *item)
     }
 }
 
-QTreeWidgetItem *MainWindow::treeAddRoot(QTreeWidget *tree, OpcUa::Node *node)
+bool MainWindow::askLinkOptions(OPCUALinkOptions &options)
 {
-    // Create new item
-    QTreeWidgetItem *item = new QTreeWidgetItem(tree);
-
-    // Assign node as data to it
-    QVariant data = QVariant::fromValue(new CouplerItem(this, OpcUa::Node(*node)));
-    item->setData(0, Qt::UserRole, data);
+    bool dialog_ok;
 
-    // Update item info
-    treeUpdateItem(item, 0);
+    // Polling is for servers that cap or mishandle monitored items
+    QStringList modes = QStringList() << "Subscription" << "Polling";
+    QString mode = QInputDialog::getItem(this, "Link options", "Acquisition", modes, options.poll ? 1 : 0, false, &dialog_ok);
+    if (!dialog_ok)
+        return false;
+    options.poll = modes.indexOf(mode) == 1;
+
+    // How often the server publishes and samples, slow tags don't need the default rate
+    options.period = (unsigned int) QInputDialog::getInt(this, "Link options", options.poll ? "Poll period (ms)" : "Publishing interval (ms)", options.period, 1, 3600000, 10, &dialog_ok);
+    if (!dialog_ok)
+        return false;
+
+    // Event links keep every sample when the broker falls behind
+    QStringList kinds = QStringList() << "State (latest value only)" << "Event (every sample)";
+    QString kind = QInputDialog::getItem(this, "Link options", "When the broker falls behind", kinds, options.coalesce ? 0 : 1, false, &dialog_ok);
+    if (!dialog_ok)
+        return false;
+    options.coalesce = kinds.indexOf(kind) == 0;
+
+    // The rest are monitored item settings
+    if (options.poll)
+        return true;
+
+    options.samplinginterval = QInputDialog::getDouble(this, "Link options", "Sampling interval (ms), -1 = publishing interval", options.samplinginterval, -1.0, 3600000.0, 1, &dialog_ok);
+    if (!dialog_ok)
+        return false;
+
+    // Fast signals need a queue to keep the changes sampled between publishes
+    options.queuesize = (uint32_t) QInputDialog::getInt(this, "Link options", "Queue size", options.queuesize, 1, 10000, 1, &dialog_ok);
+    if (!dialog_ok)
+        return false;
+
+    if (options.queuesize > 1)
+    {
+        QStringList discards = QStringList() << "Discard oldest" << "Discard newest";
+        QString discard = QInputDialog::getItem(this, "Link options", "When the queue is full", discards, options.discardoldest ? 0 : 1, false, &dialog_ok);
+        if (!dialog_ok)
+            return false;
+        options.discardoldest = discards.indexOf(discard) == 0;
+    }
 
-    // Add the item to the tree
-    tree->addTopLevelItem(item);
+    // Which changes are reported by the server
+    QStringList triggers = QStringList() << "Status" << "StatusValue" << "StatusValueTimestamp";
+    QString trigger = QInputDialog::getItem(this, "Link options", "Data change trigger", triggers, 1, false, &dialog_ok);
+    if (!dialog_ok)
+        return false;
+    options.trigger = static_cast<OpcUa::DataChangeTrigger>(triggers.indexOf(trigger));
+
+    // Changes inside the deadband are dropped by the server
+    QStringList deadbands = QStringList() << "None" << "Absolute" << "Percent";
+    QString deadband = QInputDialog::getItem(this, "Link options", "Deadband type", deadbands, 0, false, &dialog_ok);
+    if (!dialog_ok)
+        return false;
+    options.deadband = static_cast<OpcUa::DeadbandType>(deadbands.indexOf(deadband));
+
+    if (options.deadband != OpcUa::DeadbandType::None)
+    {
+        double max = options.deadband == OpcUa::DeadbandType::Percent ? 100.0 : 1e9;
+        options.deadbandvalue = QInputDialog::getDouble(this, "Link options", "Deadband value", 0.0, 0.0, max, 3, &dialog_ok);
+        if (!dialog_ok)
+            return false;
+    }
 
-    // Return result
-    return item;
+    return true;
 }
 
-QTreeWidgetItem *MainWindow::treeAddChild(QTreeWidgetItem *parent, OpcUa::Node *node)
+void MainWindow::removeOpcUaMqttLink(const QModelIndex &index)
 {
-    // Create new item
-    QTreeWidgetItem *item = new QTreeWidgetItem();
+    // Return immediately if OpcUa/MQTT client is not running
+    if (m_opcua_client->getStatus() != CONNECTED || m_mqtt_client->getStatus() != CONNECTED)
+        return;
 
-    // Assign node as data to it
-    QVariant data = QVariant::fromValue(new CouplerItem(this, OpcUa::Node(*node)));
-    item->setData(0, Qt::UserRole, data);
+    // If the subscription doesn't exist, leave
+    if (m_tree_model->getHandle(index) == 0)
+    {
+        QMessageBox::warning(this, "Subscription not found", "There was no subscription found for this node. Unlink failed.");
+        return;
+    }
 
-    // Update item info
-    treeUpdateItem(item, 0);
+    // Remove the subscription
+    try
+    {
+        if (m_opcua_client->removeOpcUaMqttLink(treeNode(index)))
+        {
+            m_tree_model->setHandle(index, 0);
 
-    // Add the item to the tree
-    parent->addChild(item);
+            std::string key = OpcUa::ToString(m_tree_model->getNodeId(index));
+            m_links.erase(key);
+            m_link_handles.erase(key);
+            saveLinks();
+        }
+    }
+    catch (const std::exception &e)
+    {
+        qDebug() << e.what();
 
-    // Return result
-    return item;
+        // Also show error as box to user
+        QMessageBox::warning(this, "Exception", QString(e.what()));
+    }
 }
 
-void MainWindow::treeShowNodeInfo(QTreeWidgetItem *item)
+void MainWindow::treeShowNodeInfo(const QModelIndex &index)
 {
     // Return immediately if OpcUa client is not running
     if (m_opcua_client->getStatus() != CONNECTED)
         return;
 
-    // Get the node by casting the QVariant data in column 0 into CouplerItem*
-    CouplerItem *item_coupler = item->data(0, Qt::UserRole).value<CouplerItem *>();
-    OpcUa::Node node_opcua = item_coupler->getOpcUaNode();
-
-    // If the data was invalid, return immediately with error.
-    if (!item_coupler)
-    {
-        qDebug() << "Critical error! Couldn't convert tree node from QVariant to CouplerItem*";
-        return;
-    }
+    // The node is rebuilt from the id kept in the tree model
+    OpcUa::Node node_opcua = treeNode(index);
 
     // Get node info as string
     std::string node_info;
@@ -294,7 +454,7 @@ void MainWindow::treeShowNodeInfo(QTreeWidgetItem *item)
         node_info.append("Object: " + node_opcua.ToString() + "\n");
         node_info.append("Name: " + node_opcua.GetBrowseName().Name + "\n");
         node_info.append("Type: " + node_opcua.GetDataType().ToString() + "\n");
-        node_info.append("Value: " + node_opcua.GetValue().ToString() + "\n");
+        node_info.append("Value: " + m_opcua_client->getRegistry()->resolve(node_opcua).GetValue().ToString() + "\n");
         std::stringstream ss1;
         ss1 << "Childs: " << node_opcua.GetChildren().size();
         node_info.append("Childs: " + ss1.str() + "\n");
@@ -317,24 +477,16 @@ void MainWindow::treeShowNodeInfo(QTreeWidgetItem *item)
     box_info.exec();
 }
 
-void MainWindow::treeSetNodeValue(QTreeWidgetItem *item, OpcUa::VariantType type)
+void MainWindow::treeSetNodeValue(const QModelIndex &index, OpcUa::VariantType type)
 {
     // Return immediately if OpcUa client is not running
     if (m_opcua_client->getStatus() != CONNECTED)
         return;
 
-    // Get the node by casting the QVariant data in column 0 into CouplerItem*
-    CouplerItem *item_coupler = item->data(0, Qt::UserRole).value<CouplerItem *>();
-    OpcUa::Node node_opcua = item_coupler->getOpcUaNode();
-
-    // If the data was invalid, return immediately with error.
-    if (!item_coupler)
-    {
-        qDebug() << "Critical error! Couldn't convert tree node from QVariant to CouplerItem*";
-        return;
-    }
+    // The node is rebuilt from the id kept in the tree model
+    OpcUa::Node node_opcua = treeNode(index);
 
-    // Request user input
+    // Request user input, written nodes stay registered for the next writes
     bool dialog_ok;
     int value_int;
     float value_float;
@@ -350,28 +502,28 @@ void MainWindow::treeSetNodeValue(QTreeWidgetItem *item, OpcUa::VariantType type
             value_int = QInputDialog::getInt(this, "Set new int value", "Input a new integer value", 0, INT_MIN, INT_MAX, 1, &dialog_ok);
             if (dialog_ok)
             {
-                node_opcua.SetValue(static_cast<int16_t>(value_int));
+                m_opcua_client->getRegistry()->keep(node_opcua).SetValue(static_cast<int16_t>(value_int));
             }
             break;
         case OpcUa::VariantType::FLOAT:
             value_float = static_cast<float>(QInputDialog::getDouble(this, "Set new float value", "Input a new floating point value", 0, INT_MIN, INT_MAX, 2, &dialog_ok));
             if (dialog_ok)
             {
-                node_opcua.SetValue(value_float);
+                m_opcua_client->getRegistry()->keep(node_opcua).SetValue(value_float);
             }
             break;
         case OpcUa::VariantType::BOOLEAN:
             value_bool = static_cast<bool>(QInputDialog::getInt(this, "Set new bool value", "Input a new boolean value", 0, 0, 1, 1, &dialog_ok));
             if (dialog_ok)
             {
-                node_opcua.SetValue(value_bool);
+                m_opcua_client->getRegistry()->keep(node_opcua).SetValue(value_bool);
             }
             break;
         case OpcUa::VariantType::STRING:
             value_string.append(QInputDialog::getText(this, "Set new string value", "Input a new string value", QLineEdit::Normal, "", &dialog_ok).toUtf8());
             if (dialog_ok)
             {
-                node_opcua.SetValue(value_string);
+                m_opcua_client->getRegistry()->keep(node_opcua).SetValue(value_string);
             }
             break;
         default:
@@ -380,7 +532,7 @@ void MainWindow::treeSetNodeValue(QTreeWidgetItem *item, OpcUa::VariantType type
         }
 
         // Update tree item
-        treeUpdateItem(item, 0);
+        treeUpdateItem(index);
     }
     catch (const std::exception &e)
     {
@@ -412,27 +564,19 @@ void MainWindow::treeSetNodeValue(QTreeWidgetItem *item, OpcUa::VariantType type
         }
 
         // Update tree item
-        treeUpdateItem(item, 0);
+        treeUpdateItem(index);
     }
     */
 }
 
-void MainWindow::treeAddNode(QTreeWidgetItem *item, int type)
+void MainWindow::treeAddNode(const QModelIndex &index, int type)
 {
     // Return immediately if OpcUa client is not running
     if (m_opcua_client->getStatus() != CONNECTED)
         return;
 
-    // Get the node by casting the QVariant data in column 0 into CouplerItem*
-    CouplerItem *item_coupler = item->data(0, Qt::UserRole).value<CouplerItem *>();
-    OpcUa::Node node_opcua = item_coupler->getOpcUaNode();
-
-    // If the data was invalid, return immediately with error.
-    if (!item_coupler)
-    {
-        qDebug() << "Critical error! Couldn't convert tree node from QVariant to CouplerItem*";
-        return;
-    }
+    // The node is rebuilt from the id kept in the tree model
+    OpcUa::Node node_opcua = treeNode(index);
 
     bool dialog_ok;
     std::string value_string;
@@ -446,6 +590,7 @@ void MainWindow::treeAddNode(QTreeWidgetItem *item, int type)
             if (dialog_ok)
             {
                 new_node = node_opcua.AddFolder(node_opcua.GetId().GetNamespaceIndex(), value_string);
+                m_tree_model->addNode(index, new_node.GetId(), value_string, OpcUa::NodeClass::Object);
             }
             break;
         case 1:
@@ -453,12 +598,10 @@ void MainWindow::treeAddNode(QTreeWidgetItem *item, int type)
             if (dialog_ok)
             {
                 new_node = node_opcua.AddVariable(node_opcua.GetId().GetNamespaceIndex(), value_string, OpcUa::Variant(std::string("new variable")));
+                m_tree_model->addNode(index, new_node.GetId(), value_string, OpcUa::NodeClass::Variable);
             }
             break;
         }
-
-        // Add new item to tree
-        treeAddChild(item, &new_node);
     }
     catch (const std::exception &e)
     {
@@ -470,36 +613,266 @@ void MainWindow::treeAddNode(QTreeWidgetItem *item, int type)
 
 }
 
-void MainWindow::treeBuildOpcUa(OpcUa::Node *node, QTreeWidgetItem *parent, int n)
+void MainWindow::treeAddBrowsedNodes(const std::vector<OPCUABrowseNode> &nodes)
 {
-    // Process QT Events while building on the main thread
-    QApplication::processEvents();
+    // Results of a browse started before a disconnect
+    if (m_opcua_client->getStatus() != CONNECTED)
+        return;
 
-    // Return immediately if OpcUa client has requested quit
-    if (m_opcua_client->getRunState() != RUNNING)
+    // Only the new nodes are matched against the link rules
+    linkRuleMatches(m_link_matcher.add(nodes));
+
+    // A full walk is kept for the snapshot, the tree may be showing the last one meanwhile
+    if (!m_tree_model->getLazy())
+        m_tree_browsed.insert(m_tree_browsed.end(), nodes.begin(), nodes.end());
+
+    // Everything shown comes with the browse result, no requests per row
+    if (!m_tree_snapshot)
+    {
+        m_tree_model->addNodes(nodes);
+        treeApplyLinks(nodes);
+    }
+}
+
+void MainWindow::treeFetchChildren(const QModelIndex &index)
+{
+    if (m_opcua_client->getStatus() != CONNECTED)
         return;
 
-    // Check if we are at root level, if so add node as root,
-    // parent at this time will be the current *node
-    // At first I used n to check at what level we are,
-    // but since that caused incorrect folder structuring
-    // I tried this and it works, but doesn't allow
-    // more than a singular real root node
-    if (!parent)
-        parent = treeAddRoot(m_ui->tv_opcua, node);
-    else
-        parent = treeAddChild(parent, node);
+    m_opcua_browser->expand(treeNode(index));
+}
+
+OpcUa::Node MainWindow::treeNode(const QModelIndex &index) const
+{
+    return OpcUa::Node(m_opcua_client->getRootNode()->GetServices(), m_tree_model->getNodeId(index));
+}
+
+void MainWindow::browseProgress(quint64 nodes, quint64 pending, double rate)
+{
+    m_ui->statusBar->showMessage("Browsing: " + QString::number(nodes) + " nodes, " + QString::number(pending) + " queued, "
+                                 + QString::number(rate, 'f', 0) + " nodes/s", 5000);
+}
 
-    // Maximum recursion reached -> return
-    if (n > 64)
+void MainWindow::browseFinished(quint64 nodes, double seconds, bool stopped)
+{
+    qDebug() << "OPCUA: Finished building the treewidget.";
+
+    m_ui->statusBar->showMessage("Browsed " + QString::number(nodes) + " nodes in " + QString::number(seconds, 'f', 1) + " s.", 10000);
+
+    if (stopped || m_tree_model->getLazy() || m_opcua_client->getStatus() != CONNECTED)
         return;
 
-    // Traverse childs, parent for all executed treeBuildOpcUa calls is *parent
-    std::vector<OpcUa::Node> node_children = node->GetChildren();
-    for (OpcUa::Node c : node_children)
+    // Swap the snapshot for the fresh walk only when the address space changed
+    if (m_tree_snapshot && !m_tree_model->matches(m_tree_browsed))
     {
-        treeBuildOpcUa(&c, parent, n++);
+        qDebug() << "OPCUA: Address space changed since the snapshot, updating the tree.";
+        m_tree_model->reset(m_tree_browsed);
+        treeApplyLinks(m_tree_browsed);
     }
+
+    OPCUASnapshot::save(m_tree_snapshotfile, m_tree_snapshoturi, m_tree_browsed);
+
+    m_tree_snapshot = false;
+    std::vector<OPCUABrowseNode>().swap(m_tree_browsed);
+}
+
+void MainWindow::restoreLinks()
+{
+    m_links.clear();
+    m_link_handles.clear();
+    m_link_matcher.clear();
+
+    QSettings settings(QString::fromStdString(m_links_file), QSettings::IniFormat);
+    std::vector<OPCUALinkSet> sets = OPCUALinkStore::load(settings);
+    m_link_matcher.setRules(OPCUALinkStore::loadRules(settings));
+
+    // Links the server refuses now stay stored, the node may come back
+    size_t total = 0;
+    for (const OPCUALinkSet &set : sets)
+    {
+        for (const OpcUa::NodeId &id : set.nodes)
+            m_links[OpcUa::ToString(id)] = set.options;
+
+        total += set.nodes.size();
+    }
+
+    // Straight from the stored NodeIds, one bulk call per set, no browse needed
+    if (total > 0)
+    {
+        size_t linked = linkSets(sets);
+
+        qDebug() << "OPCUA: Restored" << (unsigned long long) linked << "/" << (unsigned long long) total << "links from" << m_links_file.c_str();
+        m_ui->statusBar->showMessage("Restored " + QString::number(linked) + "/" + QString::number(total) + " links.", 5000);
+    }
+}
+
+size_t MainWindow::linkSets(const std::vector<OPCUALinkSet> &sets)
+{
+    OpcUa::Services::SharedPtr services = m_opcua_client->getRootNode()->GetServices();
+    size_t linked = 0;
+
+    for (const OPCUALinkSet &set : sets)
+    {
+        std::vector<OpcUa::Node> nodes;
+        nodes.reserve(set.nodes.size());
+        for (const OpcUa::NodeId &id : set.nodes)
+            nodes.push_back(OpcUa::Node(services, id));
+
+        try
+        {
+            std::vector<OPCUALinkResult> results = m_opcua_client->createOpcUaMqttLinks(nodes, set.options);
+
+            for (size_t i = 0; i < results.size(); i++)
+            {
+                if (results[i].status != OpcUa::StatusCode::Good)
+                {
+                    qDebug() << "OPCUA: Link" << nodes[i].ToString().c_str() << "failed:" << OpcUa::ToString(results[i].status).c_str();
+                    continue;
+                }
+
+                // Rows already in the tree get their mark now, the rest as they're added
+                std::string key = OpcUa::ToString(set.nodes[i]);
+                m_links[key] = set.options;
+                m_link_handles[key] = results[i].handle;
+                m_tree_model->setHandle(m_tree_model->find(key), results[i].handle);
+                linked++;
+            }
+        }
+        catch (const std::exception &e)
+        {
+            qDebug() << "OPCUA: Linking a link set failed:" << e.what();
+        }
+    }
+
+    return linked;
+}
+
+void MainWindow::linkRuleMatches(const std::vector<OPCUALinkSet> &matches)
+{
+    // Nodes linked by hand or restored already keep their own options
+    std::vector<OPCUALinkSet> sets;
+    size_t total = 0;
+    for (const OPCUALinkSet &match : matches)
+    {
+        OPCUALinkSet set;
+        set.options = match.options;
+
+        for (const OpcUa::NodeId &id : match.nodes)
+        {
+            if (!m_links.count(OpcUa::ToString(id)))
+                set.nodes.push_back(id);
+        }
+
+        total += set.nodes.size();
+        if (!set.nodes.empty())
+            sets.push_back(set);
+    }
+
+    if (total == 0)
+        return;
+
+    size_t linked = linkSets(sets);
+    if (linked > 0)
+        saveLinks();
+
+    m_ui->statusBar->showMessage("Link rules linked " + QString::number(linked) + "/" + QString::number(total) + " nodes.", 5000);
+}
+
+void MainWindow::createLinkRule(const QModelIndex &index)
+{
+    bool dialog_ok;
+    OPCUALinkRule rule;
+
+    // Everything below the selected node by default
+    QString path = QInputDialog::getText(this, "Link rule", "Browse path prefix, names separated by /", QLineEdit::Normal,
+                                         QString::fromStdString(treePath(index)), &dialog_ok);
+    if (!dialog_ok)
+        return;
+    rule.path = path.toStdString();
+
+    QStringList kinds = QStringList() << "Glob" << "Regex";
+    QString kind = QInputDialog::getItem(this, "Link rule", "Browse name pattern", kinds, 0, false, &dialog_ok);
+    if (!dialog_ok)
+        return;
+    rule.regex = kinds.indexOf(kind) == 1;
+
+    QString pattern = QInputDialog::getText(this, "Link rule", rule.regex ? "Regex on the browse name" : "Glob on the browse name (* and ?)",
+                                            QLineEdit::Normal, rule.regex ? ".*" : "*", &dialog_ok);
+    if (!dialog_ok)
+        return;
+    rule.pattern = pattern.toStdString();
+
+    rule.ns = QInputDialog::getInt(this, "Link rule", "Namespace index, -1 = any", -1, -1, 65535, 1, &dialog_ok);
+    if (!dialog_ok)
+        return;
+
+    QString datatype = QInputDialog::getText(this, "Link rule", "Data type NodeId (e.g. i=11), empty = any", QLineEdit::Normal, "", &dialog_ok);
+    if (!dialog_ok)
+        return;
+    rule.datatype = datatype.trimmed().toStdString();
+
+    if (!askLinkOptions(rule.options))
+        return;
+
+    // Matched against everything browsed so far, later nodes as they're browsed
+    std::vector<OPCUALinkRule> rules = m_link_matcher.getRules();
+    rules.push_back(rule);
+    std::vector<OPCUALinkSet> matches = m_link_matcher.setRules(rules);
+
+    QSettings settings(QString::fromStdString(m_links_file), QSettings::IniFormat);
+    OPCUALinkStore::saveRules(settings, rules);
+
+    linkRuleMatches(matches);
+}
+
+void MainWindow::clearLinkRules()
+{
+    // Nodes linked by the rules stay linked
+    m_link_matcher.setRules(std::vector<OPCUALinkRule>());
+
+    QSettings settings(QString::fromStdString(m_links_file), QSettings::IniFormat);
+    OPCUALinkStore::saveRules(settings, std::vector<OPCUALinkRule>());
+}
+
+std::string MainWindow::treePath(const QModelIndex &index) const
+{
+    std::string path;
+
+    for (QModelIndex i = index; i.isValid(); i = m_tree_model->parent(i))
+        path = path.empty() ? m_tree_model->getName(i) : m_tree_model->getName(i) + "/" + path;
+
+    return path;
+}
+
+void MainWindow::saveLinks()
+{
+    if (m_links_file.empty())
+        return;
+
+    QSettings settings(QString::fromStdString(m_links_file), QSettings::IniFormat);
+    OPCUALinkStore::save(settings, OPCUALinkStore::group(m_links));
+}
+
+void MainWindow::treeApplyLinks(const std::vector<OPCUABrowseNode> &nodes)
+{
+    if (m_link_handles.empty())
+        return;
+
+    for (const OPCUABrowseNode &node : nodes)
+    {
+        auto found = m_link_handles.find(node.key);
+        if (found != m_link_handles.end())
+            m_tree_model->setHandle(m_tree_model->find(node.key), found->second);
+    }
+}
+
+std::string MainWindow::appDataFile(const QString &dir, const std::string &uri, const QString &suffix)
+{
+    QString path = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/" + dir;
+    QDir().mkpath(path);
+
+    QByteArray hash = QCryptographicHash::hash(QByteArray::fromStdString(uri), QCryptographicHash::Sha1).toHex();
+    return (path + "/" + QString::fromLatin1(hash) + suffix).toStdString();
 }
 
 void MainWindow::setOpcUaStatus(CLIENT_STATUS status)
@@ -590,7 +963,7 @@ void MainWindow::initOpcUaClient()
 
         m_opcua_client->setTargetEndpoint(selectedEndpoint->getEndpoint());
 
-        m_ui->tv_opcua->clear();
+        m_tree_model->clear();
         m_opcua_client->start();
         QThread::msleep(1000);
 
@@ -599,20 +972,38 @@ void MainWindow::initOpcUaClient()
 
         if (m_opcua_client->getStatus() == CONNECTED)
         {
-            // Update treeview nodes
+            // Links of the last session come first, the tree isn't needed for them
+            m_links_file = appDataFile("links", m_opcua_client->getTargetEndpoint().Server.ApplicationUri, ".ini");
+            restoreLinks();
+
+            // Update treeview nodes, the browser streams them in from its own threads
             qDebug() << "OPCUA: Building treewidget nodes...";
-            m_ui->tv_opcua->clear();
+            m_tree_model->clear();
 
-            if (m_ui->rb_opcua_root->isChecked())
-            {
-                treeBuildOpcUa(m_opcua_client->getRootNode(), nullptr, 0);
-            }
-            else
+            // Lazy tree fetches one level now, the rest as items are expanded
+            m_tree_model->setLazy(m_ui->cb_opcua_lazy->isChecked());
+            int depth = m_tree_model->getLazy() ? 1 : OPCUA_BROWSE_MAX_DEPTH;
+
+            OpcUa::Node start = m_ui->rb_opcua_root->isChecked() ? *m_opcua_client->getRootNode() : *m_opcua_client->getObjectsNode();
+
+            // A full tree is shown from the last snapshot of this server while it's browsed again
+            m_tree_browsed.clear();
+            m_tree_snapshot = false;
+            m_tree_snapshoturi = m_opcua_client->getTargetEndpoint().Server.ApplicationUri + " " + start.ToString();
+            m_tree_snapshotfile = appDataFile("snapshots", m_tree_snapshoturi, ".bin");
+
+            std::vector<OPCUABrowseNode> snapshot;
+            if (!m_tree_model->getLazy() && OPCUASnapshot::load(m_tree_snapshotfile, m_tree_snapshoturi, snapshot))
             {
-                treeBuildOpcUa(m_opcua_client->getObjectsNode(), nullptr, 0);
+                m_tree_model->addNodes(snapshot);
+                treeApplyLinks(snapshot);
+                linkRuleMatches(m_link_matcher.add(snapshot));
+                m_tree_snapshot = true;
+
+                qDebug() << "OPCUA: Loaded" << (unsigned long long) snapshot.size() << "nodes from" << m_tree_snapshotfile.c_str();
             }
 
-            qDebug() << "OPCUA: Finished building the treewidget.";
+            m_opcua_browser->browse(start, depth);
         }
         else
         {
@@ -625,6 +1016,10 @@ void MainWindow::initOpcUaClient()
     }
     else
     {
+        // A browse still running would use the session being closed
+        m_opcua_browser->stop();
+        m_opcua_browser->wait();
+
         m_opcua_client->setRunState(STOPPED);
 
         while (m_opcua_client->getStatus() == CONNECTED)
@@ -677,102 +1072,94 @@ void MainWindow::initMqttClient()
 void MainWindow::setMqttTopic()
 {
     m_mqtt_client->setTopic(m_ui->le_mqtt_topic->text().toStdString());
+    m_opcua_client->getSubClient()->setTopic(m_mqtt_client->getTopic());
+}
+
+void MainWindow::setMqttPayloadMode(bool json)
+{
+    if (m_opcua_client)
+        m_opcua_client->getSubClient()->setPayloadMode(json ? PAYLOAD_JSON : PAYLOAD_VALUE);
+}
+
+void MainWindow::setMqttBatching(bool batch)
+{
+    // Window 0 closes the frames at the end of every OPC UA PublishResult
+    if (m_mqtt_client)
+    {
+        m_mqtt_client->getBatcher()->setWindow(m_mqtt_batchwindow);
+        m_mqtt_client->getBatcher()->setEnabled(batch);
+    }
 }
 
-void MainWindow::treeUpdateItem(QTreeWidgetItem *item, int slot)
+void MainWindow::treeUpdateItem(const QModelIndex &index)
 {
     // Return immediately if OpcUa client is not running
     if (m_opcua_client->getStatus() != CONNECTED)
         return;
 
-    // Get the node by casting the QVariant data in column 0 into CouplerItem*
-    CouplerItem *item_coupler = item->data(0, Qt::UserRole).value<CouplerItem *>();
-    OpcUa::Node node_opcua = item_coupler->getOpcUaNode();
+    // Id, namespace & name come with the browse, only the value is read
+    treeReadValues(std::vector<QModelIndex>(1, index));
 
-    // If the data was invalid, return immediately with error.
-    if (!item_coupler)
+    // Inform user about the update
+    m_ui->statusBar->showMessage("Updating (" + QString::fromStdString(m_tree_model->getName(index)) + ") node status in the treeview.", 5000);
+}
+
+void MainWindow::treeReadValues(const std::vector<QModelIndex> &indexes)
+{
+    std::vector<OpcUa::Node> nodes;
+    for (const QModelIndex &index : indexes)
+        nodes.push_back(treeNode(index));
+
+    std::vector<OpcUa::DataValue> values;
+    try
     {
-        qDebug() << "Critical error! Couldn't convert tree node from QVariant to CouplerItem*";
+        values = m_opcua_client->readValues(nodes);
+    }
+    catch (const std::exception &e)
+    {
+        qDebug() << e.what();
         return;
     }
 
-    // Get node info as strings
-    QString node_id;
-    QString node_ns;
-    QString node_name;
-    QString node_value;
-    try
+    // Nodes without a value (folders, objects) are left empty
+    for (size_t i = 0; i < indexes.size() && i < values.size(); i++)
     {
-        if (node_opcua.GetId().IsInteger())
+        QString node_value;
+        if ((values[i].Encoding & OpcUa::DATA_VALUE) && !values[i].Value.IsNul())
         {
-            node_id = QString::number(node_opcua.GetId().GetIntegerIdentifier());
-        } else if(node_opcua.GetId().IsString())
-        {
-            node_id = QString::fromStdString(node_opcua.GetId().GetStringIdentifier());
-        }
-        else
-        {
-            qDebug() << "Unsupported nodeid encoding type! Only integer & std::string are supported.";
-            node_id = "-1";
+            char value[MQTT_MSG_PAYLOAD_MAX];
+            int value_len = OPCUAValueEncoder::encode(values[i].Value, value, sizeof(value));
+            node_value = value_len > 0 ? QString::fromUtf8(value, value_len) : QString();
         }
 
-        node_ns = QString::number(node_opcua.GetId().GetNamespaceIndex());
-        node_name = QString::fromStdString(node_opcua.GetBrowseName().Name);
-        node_value = QString::fromStdString(node_opcua.GetValue().ToString());
-
-        if (node_value.startsWith("conversion"))
-        {
-            /* <-- Just testing... Beckhoff has many unsupported types.
-            if (node_opcua.GetValue().Type() == OpcUa::VariantType::LOCALIZED_TEXT)
-                qDebug() << "Found unsupported variant of type LOCALIZED_TEXT! name: " << node_name;
-            else if (node_opcua.GetValue().Type() == OpcUa::VariantType::BOOLEAN)
-                qDebug() << "Found unsupported variant of type BOOLEAN! name: " << node_name;
-            else if (node_opcua.GetValue().Type() == OpcUa::VariantType::QUALIFIED_NAME)
-                qDebug() << "Found unsupported variant of type QUALIFIED_NAME! name: " << node_name;
-            else if (node_opcua.GetValue().Type() == OpcUa::VariantType::NODE_Id)
-                qDebug() << "Found unsupported variant of type NODE_Id! name: " << node_name;
-            else if (node_opcua.GetValue().Type() == OpcUa::VariantType::GUId)
-                qDebug() << "Found unsupported variant of type GUId! name: " << node_name;
-            else  if (node_opcua.GetValue().Type() == OpcUa::VariantType::STATUS_CODE)
-                qDebug() << "Found unsupported variant of type STATUS_CODE! name: " << node_name;
-            else  if (node_opcua.GetValue().Type() == OpcUa::VariantType::VARIANT)
-                qDebug() << "Found unsupported variant of type VARIANT! name: " << node_name;
-            else  if (node_opcua.GetValue().Type() == OpcUa::VariantType::DIAGNOSTIC_INFO)
-                qDebug() << "Found unsupported variant of type DIAGNOSTIC_INFO! name: " << node_name;
-            */
-            node_value = "";
-        }
+        m_tree_model->setValue(indexes[i], node_value);
     }
-    catch (const std::exception &e)
-    {
-        qDebug() << e.what();
+}
 
-        node_id = "-1";
-        node_ns = "-1";
-        node_name = "null";
-        node_value = "";
-    }
+void MainWindow::treeScheduleRead()
+{
+    // At most one read per interval while scrolling or browsing
+    if (!m_tree_timer->isActive())
+        m_tree_timer->start();
+}
 
-    // Assign the info into current tree item
-    item->setText(0, node_id);
-    item->setText(1, node_ns);
-    item->setText(2, node_name);
+void MainWindow::treeReadVisible()
+{
+    if (m_opcua_client->getStatus() != CONNECTED)
+        return;
 
-    if (!node_value.isEmpty())
+    // Variables in the viewport that have not been read yet, all in one request
+    QTreeView *tree = m_ui->tv_opcua;
+    int bottom = tree->viewport()->height();
+    std::vector<QModelIndex> indexes;
+    for (QModelIndex index = tree->indexAt(QPoint(0, 0)); index.isValid() && tree->visualRect(index).top() < bottom; index = tree->indexBelow(index))
     {
-        item->setText(3, node_value);
-        if (item_coupler->getSubHandle() == 0)
-        {
-            item->setBackgroundColor(3, QColor(192, 255, 64));
-        }
-        else
-        {
-            item->setBackgroundColor(3, QColor(64, 192, 255));
-        }
+        if (m_tree_model->getNodeClass(index) == OpcUa::NodeClass::Variable && !m_tree_model->hasValue(index))
+            indexes.push_back(index);
     }
 
-    // Inform user about the update
-    m_ui->statusBar->showMessage("Updating (" + node_name + ") node status in the treeview.", 5000);
+    if (!indexes.empty())
+        treeReadValues(indexes);
 }
 
 void MainWindow::showOpcUaVarMenu(const QPoint &pos)
@@ -782,11 +1169,11 @@ void MainWindow::showOpcUaVarMenu(const QPoint &pos)
         return;
 
     // Get the tree and item
-    QTreeWidget *tree = m_ui->tv_opcua;
-    QTreeWidgetItem *item = tree->itemAt(pos);
+    QTreeView *tree = m_ui->tv_opcua;
+    QModelIndex item = tree->indexAt(pos);
 
     // Return if item does not exist
-    if (!item)
+    if (!item.isValid())
         return;
 
     // Create action
@@ -807,8 +1194,18 @@ void MainWindow::showOpcUaVarMenu(const QPoint &pos)
     QAction *action3_2 = new QAction("Add (Variable)", this);
     action3_2->setStatusTip("Add a new variable node.");
 
-    QAction *action4 = new QAction("Link", this);
+    QAction *action4 = new QAction("Node", this);
     action4->setStatusTip("Link the selected node with the MQTT server.");
+    QAction *action4_1 = new QAction("Children", this);
+    action4_1->setStatusTip("Link all child nodes of the selected node with the MQTT server.");
+    QAction *action4_2 = new QAction("Node (Options)", this);
+    action4_2->setStatusTip("Link the selected node with a data change filter.");
+    QAction *action4_3 = new QAction("Children (Options)", this);
+    action4_3->setStatusTip("Link all child nodes of the selected node with a data change filter.");
+    QAction *action4_4 = new QAction("Rule...", this);
+    action4_4->setStatusTip("Link every variable below a browse path that matches a name pattern, now and as it's browsed.");
+    QAction *action4_5 = new QAction("Clear rules", this);
+    action4_5->setStatusTip("Remove all link rules of this server, linked nodes stay linked.");
     QAction *action5 = new QAction("Unlink", this);
     action5->setStatusTip("Unlink the selected node from the MQTT server.");
 
@@ -826,7 +1223,15 @@ void MainWindow::showOpcUaVarMenu(const QPoint &pos)
     menu_add->addAction(action3_1);
     menu_add->addAction(action3_2);
 
-    menu.addAction(action4);
+    QMenu *menu_link = menu.addMenu("Link");
+    menu_link->addAction(action4);
+    menu_link->addAction(action4_1);
+    menu_link->addAction(action4_2);
+    menu_link->addAction(action4_3);
+    menu_link->addSeparator();
+    menu_link->addAction(action4_4);
+    menu_link->addAction(action4_5);
+
     menu.addAction(action5);
 
     // Show menu at fixed pos
@@ -855,6 +1260,24 @@ void MainWindow::showOpcUaVarMenu(const QPoint &pos)
             treeAddNode(item, 1);
         else if (selected == action4)
             createOpcUaMqttLink(item);
+        else if (selected == action4_1)
+            createOpcUaMqttLinks(item);
+        else if (selected == action4_2 || selected == action4_3)
+        {
+            OPCUALinkOptions options;
+
+            if (askLinkOptions(options))
+            {
+                if (selected == action4_2)
+                    createOpcUaMqttLink(item, options);
+                else
+                    createOpcUaMqttLinks(item, options);
+            }
+        }
+        else if (selected == action4_4)
+            createLinkRule(item);
+        else if (selected == action4_5)
+            clearLinkRules();
         else if (selected == action5)
             removeOpcUaMqttLink(item);
     }
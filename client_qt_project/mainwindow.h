@@ -2,9 +2,16 @@
 #define MAINWINDOW_H
 
 #include <QMainWindow>
-#include <QTreeWidget>
+#include <QModelIndex>
+#include <QTimer>
 #include <string>
+#include <map>
+#include <unordered_map>
 #include "opcuaclient.h"
+#include "opcuabrowser.h"
+#include "opcuanodemodel.h"
+#include "opcualinkstore.h"
+#include "opcualinkmatcher.h"
 #include "mqttclient.h"
 
 namespace Ui {
@@ -24,14 +31,14 @@ public:
     explicit MainWindow(QWidget *parent = 0);
     ~MainWindow();
 
-    void createOpcUaMqttLink(QTreeWidgetItem *item);
-    void removeOpcUaMqttLink(QTreeWidgetItem *item);
-    QTreeWidgetItem *treeAddRoot(QTreeWidget *tree, OpcUa::Node *node);
-    QTreeWidgetItem *treeAddChild(QTreeWidgetItem *parent, OpcUa::Node *node);
-    void treeShowNodeInfo(QTreeWidgetItem *item);
-    void treeSetNodeValue(QTreeWidgetItem *item, OpcUa::VariantType type);
-    void treeAddNode(QTreeWidgetItem *item, int type);
-    void treeBuildOpcUa(OpcUa::Node *node, QTreeWidgetItem *parent, int n);
+    void createOpcUaMqttLink(const QModelIndex &index, const OPCUALinkOptions &options = OPCUALinkOptions());
+    void createOpcUaMqttLinks(const QModelIndex &index, const OPCUALinkOptions &options = OPCUALinkOptions());
+    bool askLinkOptions(OPCUALinkOptions &options);
+    void removeOpcUaMqttLink(const QModelIndex &index);
+    void treeShowNodeInfo(const QModelIndex &index);
+    void treeSetNodeValue(const QModelIndex &index, OpcUa::VariantType type);
+    void treeAddNode(const QModelIndex &index, int type);
+    void treeReadValues(const std::vector<QModelIndex> &indexes);
     void setOpcUaStatus(CLIENT_STATUS status);
     void setMqttStatus(CLIENT_STATUS status);
 
@@ -43,16 +50,50 @@ public slots:
     void initOpcUaClient();
     void initMqttClient();
     void setMqttTopic();
-    void treeUpdateItem(QTreeWidgetItem *item, int slot);
+    void setMqttPayloadMode(bool json);
+    void setMqttBatching(bool batch);
+    void treeUpdateItem(const QModelIndex &index);
     void showOpcUaVarMenu(const QPoint &pos);
+    void treeAddBrowsedNodes(const std::vector<OPCUABrowseNode> &nodes);
+    void treeFetchChildren(const QModelIndex &index);
+    void treeScheduleRead();
+    void treeReadVisible();
+    void browseProgress(quint64 nodes, quint64 pending, double rate);
+    void browseFinished(quint64 nodes, double seconds, bool stopped);
 
 private:
+    void restoreLinks();
+    void saveLinks();
+    size_t linkSets(const std::vector<OPCUALinkSet> &sets);
+    void linkRuleMatches(const std::vector<OPCUALinkSet> &matches);
+    void createLinkRule(const QModelIndex &index);
+    void clearLinkRules();
+    std::string treePath(const QModelIndex &index) const;
+    void treeApplyLinks(const std::vector<OPCUABrowseNode> &nodes);
+    OpcUa::Node treeNode(const QModelIndex &index) const;
+    static std::string appDataFile(const QString &dir, const std::string &uri, const QString &suffix);
+
     Ui::MainWindow *m_ui;
     AboutDialog *m_about;
     QString m_settingsFile;
     std::string m_opcua_addr;
     std::string m_mqtt_addr;
+    unsigned int m_opcua_maxitems;
+    int m_mqtt_batchwindow;
+    int m_mqtt_connections;
+    bool m_mqtt_native;
     OPCUAClient *m_opcua_client;
+    OPCUABrowser *m_opcua_browser;
+    OPCUANodeModel *m_tree_model;
+    QTimer *m_tree_timer;
+    std::vector<OPCUABrowseNode> m_tree_browsed;
+    bool m_tree_snapshot;
+    std::string m_tree_snapshoturi;
+    std::string m_tree_snapshotfile;
+    std::map<std::string, OPCUALinkOptions> m_links;
+    std::unordered_map<std::string, uint32_t> m_link_handles;
+    std::string m_links_file;
+    OPCUALinkMatcher m_link_matcher;
     MQTTClient *m_mqtt_client;
 
 };
@@ -0,0 +1,148 @@
+#include "mqttbatcher.h"
+#include "mqttclient.h"
+#include "mqttqueue.h"
+#include <algorithm>
+
+// --------------------------------------------------------
+// MQTTBatcher class below
+// --------------------------------------------------------
+MQTTBatcher::MQTTBatcher(MQTTClient *client, size_t maxsize, int window) :
+    m_client(client),
+    m_maxsize(std::min<size_t>(maxsize, MQTT_MSG_PAYLOAD_MAX)),
+    m_enabled(false),
+    m_window(window),
+    m_frames(std::map<std::string, Frame>()),
+    m_framecount(0),
+    m_valuecount(0)
+{
+
+}
+
+bool MQTTBatcher::add(const std::string &group, uint32_t id, const std::string &key, const char *value, size_t valuelen)
+{
+    // Entry plus separator and the closing brace of the frame
+    size_t entrylen = key.size() + 1 + valuelen + 2;
+    if (entrylen > m_maxsize)
+        return false;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    Frame &frame = m_frames[group];
+
+    if (!frame.ids.empty() &&
+            (frame.payload.size() + entrylen > m_maxsize || std::find(frame.ids.begin(), frame.ids.end(), id) != frame.ids.end()))
+        closeFrame(group, frame);
+
+    if (frame.ids.empty())
+    {
+        frame.payload.reserve(m_maxsize);
+        frame.payload.push_back('{');
+        frame.opened = std::chrono::steady_clock::now();
+
+        // The first publisher may be sleeping without a deadline
+        if (m_window.load(std::memory_order_relaxed) > 0)
+            m_client->getConnection(0)->getQueue()->wake();
+    }
+    else
+    {
+        frame.payload.push_back(',');
+    }
+
+    frame.payload.append(key);
+    frame.payload.push_back(':');
+    frame.payload.append(value, valuelen);
+    frame.ids.push_back(id);
+
+    m_valuecount.fetch_add(1, std::memory_order_relaxed);
+
+    return true;
+}
+
+void MQTTBatcher::flush()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (auto &it : m_frames)
+    {
+        if (!it.second.ids.empty())
+            closeFrame(it.first, it.second);
+    }
+}
+
+int MQTTBatcher::flushExpired()
+{
+    int window = m_window.load(std::memory_order_relaxed);
+    if (window <= 0)
+        return -1;
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point limit = now - std::chrono::milliseconds(window);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Ms until the oldest frame still open is due, -1 when none is
+    int next = -1;
+    for (auto &it : m_frames)
+    {
+        if (it.second.ids.empty())
+            continue;
+
+        if (it.second.opened <= limit)
+        {
+            closeFrame(it.first, it.second);
+            continue;
+        }
+
+        int due = (int) std::chrono::duration_cast<std::chrono::milliseconds>(it.second.opened - limit).count() + 1;
+        if (next < 0 || due < next)
+            next = due;
+    }
+
+    return next;
+}
+
+void MQTTBatcher::closeFrame(const std::string &group, Frame &frame)
+{
+    frame.payload.push_back('}');
+
+    // A frame carries many links, it must never be replaced by a later one
+    if (m_client->publish_topic(group, (int) frame.payload.size(), frame.payload.data(), true))
+        m_framecount.fetch_add(1, std::memory_order_relaxed);
+
+    // Keeps the capacity for the next frame
+    frame.payload.clear();
+    frame.ids.clear();
+}
+
+void MQTTBatcher::setEnabled(bool enabled)
+{
+    m_enabled.store(enabled, std::memory_order_relaxed);
+
+    if (!enabled)
+        flush();
+}
+
+void MQTTBatcher::setWindow(int window)
+{
+    m_window.store(window > 0 ? window : 0, std::memory_order_relaxed);
+}
+
+bool MQTTBatcher::isEnabled() const
+{
+    return m_enabled.load(std::memory_order_relaxed);
+}
+
+int MQTTBatcher::getWindow() const
+{
+    return m_window.load(std::memory_order_relaxed);
+}
+
+uint64_t MQTTBatcher::getFrames() const
+{
+    return m_framecount.load(std::memory_order_relaxed);
+}
+
+uint64_t MQTTBatcher::getValues() const
+{
+    return m_valuecount.load(std::memory_order_relaxed);
+}
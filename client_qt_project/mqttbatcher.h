@@ -0,0 +1,62 @@
+#ifndef MQTTBATCHER_H
+#define MQTTBATCHER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "config.h"
+
+class MQTTClient;
+
+// --------------------------------------------------------
+// MQTTBatcher class, packs value changes into one frame per topic group
+// A frame is a JSON object of "key":value entries published to the group
+// topic. It is closed when the next entry doesn't fit in maxsize, when the
+// same id shows up twice (so no sample is lost), on flush() at the end of
+// an OPC UA PublishResult, or by flushExpired() once the window has passed.
+// Opening a frame with a window wakes the publisher that closes them, it
+// otherwise sleeps until the next frame is due.
+// --------------------------------------------------------
+class MQTTBatcher
+{
+
+public:
+    MQTTBatcher(MQTTClient *client = nullptr, size_t maxsize = MQTT_BATCH_PAYLOAD_MAX, int window = 0);
+
+    bool add(const std::string &group, uint32_t id, const std::string &key, const char *value, size_t valuelen);
+    void flush();
+    int flushExpired();
+    void setEnabled(bool enabled);
+    void setWindow(int window);
+    bool isEnabled() const;
+    int getWindow() const;
+    uint64_t getFrames() const;
+    uint64_t getValues() const;
+
+private:
+    struct Frame
+    {
+        std::string payload;
+        std::vector<uint32_t> ids;
+        std::chrono::steady_clock::time_point opened;
+    };
+
+    void closeFrame(const std::string &group, Frame &frame);
+
+    MQTTClient *m_client;
+    size_t m_maxsize;
+    std::atomic<bool> m_enabled;
+    std::atomic<int> m_window; // ms, 0 = one frame per PublishResult
+    std::map<std::string, Frame> m_frames;
+    std::mutex m_mutex;
+    std::atomic<uint64_t> m_framecount;
+    std::atomic<uint64_t> m_valuecount;
+
+};
+
+#endif // MQTTBATCHER_H
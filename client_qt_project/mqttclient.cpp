@@ -1,100 +1,26 @@
 #include "mqttclient.h"
+#include "mqttqueue.h"
+#include "mqttpublisher.h"
+#include "mqttbatcher.h"
+#include "config.h"
 #include <QDebug>
-
-// --------------------------------------------------------
-// Callback functions below
-// --------------------------------------------------------
-void on_connect(struct mosquitto *mosq, void *obj, int rc)
-{
-    MQTTClient *client = (MQTTClient *) obj;
-
-    if (rc == 0) // Success
-    {
-        qDebug() << "MQTT: Successful connect!";
-
-        client->setStatus(CONNECTED);
-    }
-    else if (rc == 1) // Refused (Unacceptable protocol version)
-    {
-        qDebug() << "MQTT: Connection refused (Unacceptable protocol version).";
-
-        client->setStatus(ERROR);
-    }
-    else if (rc == 2) // Refused (Identifier rejected)
-    {
-        qDebug() << "MQTT: Connection refused (Identifier rejected).";
-
-        client->setStatus(ERROR);
-    }
-    else if (rc == 3) // Refused (Broker unavailable)
-    {
-        qDebug() << "MQTT: Connection refused (Broker unavailable).";
-
-        client->setStatus(ERROR);
-    }
-    else // Refused (Unknown)
-    {
-        qDebug() << "MQTT: Connection refused (Unknown).";
-
-        client->setStatus(ERROR);
-    }
-}
-
-void on_disconnect(struct mosquitto *mosq, void *obj, int rc)
-{
-    MQTTClient *client = (MQTTClient *) obj;
-
-    if (rc == 0) // Disconnected via mosquitto_disconnect
-    {
-        qDebug() << "MQTT: Disconnected (mosquitto_disconnect).";
-
-        client->setStatus(DISCONNECTED);
-    }
-    else // Unexpected disconnection
-    {
-        qDebug() << "MQTT: Disconnected (Unexpected).";
-
-        client->setStatus(DISCONNECTED);
-    }
-}
-
-void on_publish(struct mosquitto *mosq, void *obj, int rc)
-{
-
-}
-
-void on_message(struct mosquitto *mosq, void *obj, const struct mosquitto_message *message)
-{
-
-}
-
-void on_subscribe(struct mosquitto *mosq, void *obj, int mid, int qos_count, const int *granted_qos)
-{
-
-}
-
-void on_unsubscribe(struct mosquitto *mosq, void *obj, int mid)
-{
-
-}
-
-void on_log(struct mosquitto *mosq, void *obj, int level, const char *str)
-{
-    //qDebug() << "MQTT: " << str;
-}
+#include <chrono>
 
 // --------------------------------------------------------
 // MQTTClient class below
 // --------------------------------------------------------
-MQTTClient::MQTTClient(std::string host, int port, int id, std::string topic) :
-    m_client(NULL),
+MQTTClient::MQTTClient(std::string host, int port, int id, std::string topic, int connections, bool native) :
+    m_connections(std::vector<MQTTConnection *>()),
+    m_batcher(nullptr),
     m_host(host),
     m_port(port),
     m_id(id),
     m_topic(topic),
-    m_runstate(NOTSTARTED),
-    m_status(DISCONNECTED)
+    m_runstate(NOTSTARTED)
 {
+    m_batcher = new MQTTBatcher(this, MQTT_BATCH_PAYLOAD_MAX);
+    createConnections(connections, native);
+
     mosqpp::lib_init();
     int major = 0, minor = 0, revision = 0;
     mosqpp::lib_version(&major, &minor, &revision);
@@ -103,40 +29,26 @@ MQTTClient::MQTTClient(std::string host, int port, int id, std::string topic) :
 
 MQTTClient::~MQTTClient()
 {
-    destroy_client();
+    deleteConnections();
     mosqpp::lib_cleanup();
-}
 
-void MQTTClient::create_client()
-{
-    if (m_client == nullptr || m_client == NULL)
-    {
-        m_client = mosquitto_new(NULL, true, (void *) this); // pass pointer of this class as user data, to be used in callbacks
-        mosquitto_connect_callback_set(m_client, on_connect);
-        mosquitto_disconnect_callback_set(m_client, on_disconnect);
-        mosquitto_publish_callback_set(m_client, on_publish);
-        mosquitto_message_callback_set(m_client, on_message);
-        mosquitto_subscribe_callback_set(m_client, on_subscribe);
-        mosquitto_unsubscribe_callback_set(m_client, on_unsubscribe);
-        mosquitto_log_callback_set(m_client, on_log);
-    }
+    delete m_batcher;
 }
 
-void MQTTClient::destroy_client()
+void MQTTClient::publish_message(std::string subtopic, int payloadlen, const void *payload)
 {
-    if (m_client != NULL)
-    {
-        if (m_status == CONNECTED)
-            mosquitto_disconnect(m_client);
-
-        mosquitto_destroy(m_client);
-        m_client = NULL;
-    }
+    publish_topic(m_topic + "/" + subtopic, payloadlen, payload);
 }
 
-void MQTTClient::publish_message(std::string subtopic, int payloadlen, const void *payload)
+bool MQTTClient::publish_topic(const std::string &topic, int payloadlen, const void *payload, bool keepall)
 {
-    mosquitto_publish(m_client, NULL, (m_topic + "/" + subtopic).c_str(), payloadlen, payload, 1, true);
+    // Hand over to the publisher thread of the topic's connection, never blocks the caller.
+    // Topics of a dropped connection are skipped, the others keep flowing
+    MQTTConnection *connection = connectionFor(topic);
+    if (connection->getStatus() != CONNECTED)
+        return false;
+
+    return connection->getQueue()->push(topic, (const char *) payload, (size_t) payloadlen, keepall);
 }
 
 void MQTTClient::run()
@@ -144,80 +56,92 @@ void MQTTClient::run()
     if (m_runstate != NOTSTARTED && m_runstate != FINISHED)
         return;
 
-    // Delete old instance of the client if it somehow still exists
-    destroy_client();
-
-    // Create client instance with random ID
-    create_client();
-
     m_runstate = RUNNING;
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
 
-    // Connect to target server, the error checking has to be done here like this because
-    // connect callback doesn't work at this point.
-    qDebug() << "MQTT: Connecting to" << m_host.c_str() << "...";
-    int valueconnect = mosquitto_connect(m_client, m_host.c_str(), m_port, 60);
+    // Each connection connects & reconnects on its own thread
+    for (MQTTConnection *connection : m_connections)
+        connection->start();
 
-    if (valueconnect != MOSQ_ERR_SUCCESS)
+    // A connection that gave up takes the others down, its topics would stall
+    while (m_runstate == RUNNING)
     {
-        qDebug() << "MQTT: Failed to connect to selected server.";
-        m_runstate = NOTSTARTED;
-        m_status = ERROR;
-        return;
+        for (MQTTConnection *connection : m_connections)
+        {
+            if (connection->isFinished())
+                m_runstate = STOPPED;
+        }
+
+        msleep(100);
     }
 
-    m_status = CONNECTED;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
 
-    if (m_status != CONNECTED)
+    for (MQTTConnection *connection : m_connections)
     {
-        m_runstate = NOTSTARTED;
-        return;
+        connection->setRunState(STOPPED);
+        connection->wait();
+
+        // Rate over the whole run, writes are the send syscalls of a native connection
+        MQTTPublisher *publisher = connection->getPublisher();
+        uint64_t writes = 0;
+        uint64_t packets = 0;
+#ifdef MQTT_USE_EPOLL
+        MQTTWire *wire = connection->getWire();
+        writes = wire ? wire->getWrites() : 0;
+        packets = wire ? wire->getPackets() : 0;
+#endif
+        qDebug() << "MQTT: Connection" << connection->getIndex() << "published" << (unsigned long long) publisher->getPublished()
+                 << "acked" << (unsigned long long) connection->getAcked() << "failed" << (unsigned long long) publisher->getFailed()
+                 << "wakeups" << (unsigned long long) connection->getWakeups()
+                 << "msg/s" << (seconds > 0 ? publisher->getPublished() / seconds : 0.0)
+                 << "writes" << (unsigned long long) writes << "writes/msg" << (packets > 0 ? (double) writes / packets : 0.0)
+                 << "p50 us" << (unsigned long long) publisher->getLatency().getPercentile(0.5)
+                 << "p99 us" << (unsigned long long) publisher->getLatency().getPercentile(0.99);
     }
 
-    // TODO: This could be set to be configurable via GUI
-    int reconnAttempts = 0;
-    int reconnMax = 100;
+    m_runstate = FINISHED;
+}
 
-    while (m_runstate == RUNNING)
+void MQTTClient::createConnections(int connections, bool native)
+{
+#ifndef MQTT_USE_EPOLL
+    if (native)
+        qDebug() << "MQTT: Native publisher needs the epoll loop, using libmosquitto.";
+#endif
+
+    // Only the first publisher closes expired batch frames, the batcher is shared
+    for (int i = 0; i < (connections > 0 ? connections : 1); i++)
+        m_connections.push_back(new MQTTConnection(this, i, i == 0 ? m_batcher : nullptr, native));
+}
+
+void MQTTClient::deleteConnections()
+{
+    for (MQTTConnection *connection : m_connections)
     {
-        if (m_status == ERROR)
-        {
-            m_runstate = STOPPED;
-        }
-        else
+        if (connection->isRunning())
         {
-            if (reconnAttempts >= reconnMax)
-            {
-                m_status = DISCONNECTED;
-                m_runstate = STOPPED;
-            }
-
-            if (m_status == DISCONNECTED && reconnAttempts < reconnMax)
-            {
-                qDebug() << "MQTT: Disconnected from server! Attempting to reconnect, attempts: " << reconnAttempts << "/" << reconnMax;
-
-                int valuereconnect = mosquitto_reconnect(m_client);
-                reconnAttempts++;
-
-                /* <-- Not needed because we are relying completely on the callback functions now for state changes.
-                if (valueconnect != MOSQ_ERR_SUCCESS)
-                {
-                    qDebug() << "MQTT: Failed to reconnect to the selected server.";
-                }
-                else
-                {
-                    qDebug() << "MQTT: Successfully reconnected to the selected server!";
-                    reconnAttempts = 0;
-                }
-                */
-            }
-
-            mosquitto_loop(m_client, -1, 1);
+            connection->setRunState(STOPPED);
+            connection->wait();
         }
+
+        delete connection;
     }
 
-    destroy_client();
-    m_runstate = FINISHED;
-    qDebug() << "MQTT: Disconnecting from server...";
+    m_connections.clear();
+}
+
+uint32_t MQTTClient::topicHash(const std::string &topic)
+{
+    // FNV-1a, stable across runs & platforms
+    uint32_t hash = 2166136261u;
+    for (char c : topic)
+    {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 16777619u;
+    }
+
+    return hash;
 }
 
 void MQTTClient::setHost(std::string host)
@@ -240,11 +164,6 @@ void MQTTClient::setRunState(const CLIENT_STATE state)
     m_runstate = state;
 }
 
-void MQTTClient::setStatus(const CLIENT_STATUS status)
-{
-    m_status = status;
-}
-
 std::string MQTTClient::getHost() const
 {
     return m_host;
@@ -272,5 +191,45 @@ CLIENT_STATE MQTTClient::getRunState() const
 
 CLIENT_STATUS MQTTClient::getStatus() const
 {
-    return m_status;
+    // Connected only when every connection is, an error on any of them is shown
+    CLIENT_STATUS status = CONNECTED;
+    for (MQTTConnection *connection : m_connections)
+    {
+        if (connection->getStatus() == ERROR)
+            return ERROR;
+
+        if (connection->getStatus() != CONNECTED)
+            status = DISCONNECTED;
+    }
+
+    return status;
+}
+
+MQTTBatcher *MQTTClient::getBatcher() const
+{
+    return m_batcher;
+}
+
+int MQTTClient::getConnectionCount() const
+{
+    return static_cast<int>(m_connections.size());
+}
+
+MQTTConnection *MQTTClient::getConnection(int index) const
+{
+    return m_connections[index];
+}
+
+MQTTConnection *MQTTClient::connectionFor(const std::string &topic) const
+{
+    return m_connections[topicHash(topic) % m_connections.size()];
+}
+
+int MQTTClient::getInflight() const
+{
+    int inflight = 0;
+    for (MQTTConnection *connection : m_connections)
+        inflight += connection->getInflight();
+
+    return inflight;
 }
@@ -3,23 +3,24 @@
 
 #include <QThread>
 #include <string>
-#include <mosquitto.h>
+#include <vector>
+#include <cstdint>
 #include <cpp/mosquittopp.h>
 #include "clientstates.h"
+#include "mqttconnection.h"
+#include "config.h"
 
-// --------------------------------------------------------
-// Callback functions below
-// --------------------------------------------------------
-void on_connect(struct mosquitto *mosq, void *obj, int rc);
-void on_disconnect(struct mosquitto *mosq, void *obj, int rc);
-void on_publish(struct mosquitto *mosq, void *obj, int rc);
-void on_message(struct mosquitto *mosq, void *obj, const struct mosquitto_message *message);
-void on_subscribe(struct mosquitto *mosq, void *obj, int mid, int qos_count, const int *granted_qos);
-void on_unsubscribe(struct mosquitto *mosq, void *obj, int mid);
-void on_log(struct mosquitto *mosq, void *obj, int level, const char *str);
+class MQTTBatcher;
 
 // --------------------------------------------------------
 // MQTTClient class below
+// A pool of broker connections, each with its own queue, publisher thread
+// and inflight window. A topic always goes to the same connection (FNV-1a
+// hash of the topic), so the order of the values of one topic is kept.
+// The connections live as long as the client, producers never see them change.
+// A message is only taken while the connection of its topic is connected,
+// the aggregate getStatus is for display.
+// Native connections publish with MQTTWire instead of libmosquitto (Linux).
 //
 // TODO: Add encryption support (SSL/TLS)
 // --------------------------------------------------------
@@ -28,32 +29,39 @@ class MQTTClient : public QThread
     Q_OBJECT
 
 public:
-    MQTTClient(std::string host = "localhost", int port = 1883, int id = 0, std::string topic = "opcuamqtt");
+    MQTTClient(std::string host = "localhost", int port = 1883, int id = 0, std::string topic = "opcuamqtt", int connections = MQTT_CONNECTIONS, bool native = false);
     ~MQTTClient();
 
-    void create_client();
-    void destroy_client();
     void publish_message(std::string subtopic, int payloadlen, const void *payload);
+    bool publish_topic(const std::string &topic, int payloadlen, const void *payload, bool keepall = false);
     void setHost(std::string host);
     void setPort(int port);
     void setTopic(std::string topic);
     void setRunState(const CLIENT_STATE state);
-    void setStatus(const CLIENT_STATUS status);
     std::string getHost() const;
     int getPort() const;
     int getId() const;
     std::string getTopic() const;
     CLIENT_STATE getRunState() const;
     CLIENT_STATUS getStatus() const;
+    MQTTBatcher *getBatcher() const;
+    int getConnectionCount() const;
+    MQTTConnection *getConnection(int index) const;
+    MQTTConnection *connectionFor(const std::string &topic) const;
+    int getInflight() const;
+    static uint32_t topicHash(const std::string &topic);
 
 private:
-    mosquitto *m_client;
+    void createConnections(int connections, bool native);
+    void deleteConnections();
+
+    std::vector<MQTTConnection *> m_connections;
+    MQTTBatcher *m_batcher;
     std::string m_host;
     int m_port;
     int m_id;
     std::string m_topic;
     volatile CLIENT_STATE m_runstate;
-    volatile CLIENT_STATUS m_status;
 
 protected:
     void run() override;
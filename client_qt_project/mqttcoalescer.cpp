@@ -0,0 +1,112 @@
+#include "mqttcoalescer.h"
+#include <cstring>
+
+// --------------------------------------------------------
+// MQTTCoalescer class below
+// --------------------------------------------------------
+MQTTCoalescer::MQTTCoalescer(size_t maxevents) :
+    m_maxevents(maxevents),
+    m_index(std::unordered_map<std::string, size_t>()),
+    m_entries(std::vector<Entry>()),
+    m_events(std::deque<MQTTMessage>()),
+    m_order(std::deque<size_t>()),
+    m_replaced(0),
+    m_dropped(0)
+{
+
+}
+
+void MQTTCoalescer::put(const MQTTMessage &msg)
+{
+    if (msg.keepall)
+    {
+        if (m_events.size() >= m_maxevents)
+        {
+            m_dropped++;
+            return;
+        }
+
+        m_events.emplace_back();
+        copyMessage(m_events.back(), msg);
+        m_order.push_back(SIZE_MAX);
+        return;
+    }
+
+    auto it = m_index.find(std::string(msg.topic, msg.topiclen));
+    if (it == m_index.end())
+    {
+        it = m_index.insert(std::make_pair(std::string(msg.topic, msg.topiclen), m_entries.size())).first;
+        m_entries.emplace_back();
+        m_entries.back().pending = false;
+    }
+
+    // Still waiting for the broker, the older value is overwritten in its place
+    Entry &entry = m_entries[it->second];
+    if (entry.pending)
+        m_replaced++;
+    else
+        m_order.push_back(it->second);
+
+    entry.pending = true;
+    copyMessage(entry.msg, msg);
+}
+
+const MQTTMessage *MQTTCoalescer::front() const
+{
+    if (m_order.empty())
+        return nullptr;
+
+    size_t idx = m_order.front();
+
+    return idx == SIZE_MAX ? &m_events.front() : &m_entries[idx].msg;
+}
+
+void MQTTCoalescer::pop()
+{
+    if (m_order.empty())
+        return;
+
+    size_t idx = m_order.front();
+    m_order.pop_front();
+
+    if (idx == SIZE_MAX)
+        m_events.pop_front();
+    else
+        m_entries[idx].pending = false;
+}
+
+bool MQTTCoalescer::empty() const
+{
+    return m_order.empty();
+}
+
+size_t MQTTCoalescer::getPending() const
+{
+    return m_order.size();
+}
+
+size_t MQTTCoalescer::getTopics() const
+{
+    return m_entries.size();
+}
+
+uint64_t MQTTCoalescer::getReplaced() const
+{
+    return m_replaced;
+}
+
+uint64_t MQTTCoalescer::getDropped() const
+{
+    return m_dropped;
+}
+
+void MQTTCoalescer::copyMessage(MQTTMessage &dst, const MQTTMessage &src)
+{
+    // Only the used part of the fixed size buffers
+    dst.topiclen = src.topiclen;
+    dst.payloadlen = src.payloadlen;
+    dst.keepall = src.keepall;
+    dst.queued = src.queued;
+    std::memcpy(dst.topic, src.topic, src.topiclen + 1);
+    std::memcpy(dst.payload, src.payload, src.payloadlen);
+}
@@ -0,0 +1,55 @@
+#ifndef MQTTCOALESCER_H
+#define MQTTCOALESCER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "mqttqueue.h"
+
+// --------------------------------------------------------
+// MQTTCoalescer class, last value wins table for a broker that falls behind
+// Holds the messages the publisher couldn't hand to mosquitto yet. A newer
+// message for a topic that is still pending replaces the old one in place,
+// so the state table is bounded by the number of topics, not by how long
+// the broker stays slow. Messages with keepall set (event links, frames)
+// are kept in order instead, up to maxevents, the rest are dropped.
+// Used by the publisher thread only, no locking.
+// --------------------------------------------------------
+class MQTTCoalescer
+{
+
+public:
+    MQTTCoalescer(size_t maxevents = MQTT_QUEUE_SIZE);
+
+    void put(const MQTTMessage &msg);
+    const MQTTMessage *front() const;
+    void pop();
+    bool empty() const;
+    size_t getPending() const;
+    size_t getTopics() const;
+    uint64_t getReplaced() const;
+    uint64_t getDropped() const;
+
+private:
+    struct Entry
+    {
+        bool pending;
+        MQTTMessage msg;
+    };
+
+    static void copyMessage(MQTTMessage &dst, const MQTTMessage &src);
+
+    size_t m_maxevents;
+    std::unordered_map<std::string, size_t> m_index; // topic -> entry
+    std::vector<Entry> m_entries;
+    std::deque<MQTTMessage> m_events;
+    std::deque<size_t> m_order; // pending entries in arrival order, SIZE_MAX = next event
+    uint64_t m_replaced;
+    uint64_t m_dropped;
+
+};
+
+#endif // MQTTCOALESCER_H
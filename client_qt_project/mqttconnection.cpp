@@ -0,0 +1,589 @@
+#include "mqttconnection.h"
+#include "mqttclient.h"
+#include "mqttqueue.h"
+#include "mqttpublisher.h"
+#include "config.h"
+#include <QDebug>
+
+#ifdef MQTT_USE_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+// --------------------------------------------------------
+// Callback functions below
+// --------------------------------------------------------
+void on_connect(struct mosquitto *mosq, void *obj, int rc)
+{
+    MQTTConnection *client = (MQTTConnection *) obj;
+
+    if (rc == 0) // Success
+    {
+        qDebug() << "MQTT: Connection" << client->getIndex() << "connected.";
+
+        client->setStatus(CONNECTED);
+        client->getQueue()->wake();
+    }
+    else if (rc == 1) // Refused (Unacceptable protocol version)
+    {
+        qDebug() << "MQTT: Connection refused (Unacceptable protocol version).";
+
+        client->setStatus(ERROR);
+    }
+    else if (rc == 2) // Refused (Identifier rejected)
+    {
+        qDebug() << "MQTT: Connection refused (Identifier rejected).";
+
+        client->setStatus(ERROR);
+    }
+    else if (rc == 3) // Refused (Broker unavailable)
+    {
+        qDebug() << "MQTT: Connection refused (Broker unavailable).";
+
+        client->setStatus(ERROR);
+    }
+    else // Refused (Unknown)
+    {
+        qDebug() << "MQTT: Connection refused (Unknown).";
+
+        client->setStatus(ERROR);
+    }
+}
+
+void on_disconnect(struct mosquitto *mosq, void *obj, int rc)
+{
+    MQTTConnection *client = (MQTTConnection *) obj;
+
+    if (rc == 0) // Disconnected via mosquitto_disconnect
+    {
+        qDebug() << "MQTT: Connection" << client->getIndex() << "disconnected (mosquitto_disconnect).";
+
+        client->setStatus(DISCONNECTED);
+    }
+    else // Unexpected disconnection
+    {
+        qDebug() << "MQTT: Connection" << client->getIndex() << "disconnected (Unexpected).";
+
+        client->setStatus(DISCONNECTED);
+    }
+}
+
+void on_publish(struct mosquitto *mosq, void *obj, int rc)
+{
+    MQTTConnection *client = (MQTTConnection *) obj;
+
+    client->publish_acked();
+}
+
+void on_message(struct mosquitto *mosq, void *obj, const struct mosquitto_message *message)
+{
+
+}
+
+void on_subscribe(struct mosquitto *mosq, void *obj, int mid, int qos_count, const int *granted_qos)
+{
+
+}
+
+void on_unsubscribe(struct mosquitto *mosq, void *obj, int mid)
+{
+
+}
+
+void on_log(struct mosquitto *mosq, void *obj, int level, const char *str)
+{
+    //qDebug() << "MQTT: " << str;
+}
+
+// --------------------------------------------------------
+// MQTTConnection class below
+// --------------------------------------------------------
+MQTTConnection::MQTTConnection(MQTTClient *client, int index, MQTTBatcher *batcher, bool native) :
+    m_mqttclient(client),
+    m_index(index),
+    m_client(NULL),
+#ifdef MQTT_USE_EPOLL
+    m_wire(nullptr),
+#endif
+    m_queue(new MQTTQueue(MQTT_QUEUE_SIZE)),
+    m_publisher(nullptr),
+    m_runstate(NOTSTARTED),
+    m_status(DISCONNECTED),
+    m_inflight(0),
+    m_acked(0),
+    m_wakeups(0),
+    m_epollfd(-1),
+    m_wakefd(-1),
+    m_watchfd(-1),
+    m_watchout(false)
+{
+    m_publisher = new MQTTPublisher(this, m_queue, batcher, MQTT_PUBLISH_BATCH);
+
+#ifdef MQTT_USE_EPOLL
+    if (native)
+        m_wire = new MQTTWire(MQTT_WIRE_BUFFERS, MQTT_WIRE_BUFFER_SIZE);
+#else
+    (void) native;
+#endif
+}
+
+MQTTConnection::~MQTTConnection()
+{
+    stop_publisher();
+    destroy_client();
+
+    delete m_publisher;
+    delete m_queue;
+#ifdef MQTT_USE_EPOLL
+    delete m_wire;
+#endif
+}
+
+void MQTTConnection::create_client()
+{
+    if (m_client == nullptr || m_client == NULL)
+    {
+        m_client = mosquitto_new(NULL, true, (void *) this); // pass pointer of this class as user data, to be used in callbacks
+        mosquitto_connect_callback_set(m_client, on_connect);
+        mosquitto_disconnect_callback_set(m_client, on_disconnect);
+        mosquitto_publish_callback_set(m_client, on_publish);
+        mosquitto_message_callback_set(m_client, on_message);
+        mosquitto_subscribe_callback_set(m_client, on_subscribe);
+        mosquitto_unsubscribe_callback_set(m_client, on_unsubscribe);
+        mosquitto_log_callback_set(m_client, on_log);
+        mosquitto_max_inflight_messages_set(m_client, MQTT_INFLIGHT_WINDOW);
+    }
+}
+
+void MQTTConnection::destroy_client()
+{
+#ifdef MQTT_USE_EPOLL
+    if (m_wire)
+        m_wire->close();
+#endif
+
+    if (m_client != NULL)
+    {
+        if (m_status == CONNECTED)
+            mosquitto_disconnect(m_client);
+
+        mosquitto_destroy(m_client);
+        m_client = NULL;
+    }
+}
+
+int MQTTConnection::publish_raw(const MQTTMessage &msg)
+{
+    int rc;
+
+#ifdef MQTT_USE_EPOLL
+    if (m_wire)
+        rc = m_wire->publish(msg) ? MOSQ_ERR_SUCCESS : MOSQ_ERR_NOMEM;
+    else
+#endif
+    rc = mosquitto_publish(m_client, NULL, msg.topic, (int) msg.payloadlen, msg.payload, 1, true);
+
+    if (rc == MOSQ_ERR_SUCCESS)
+        m_inflight.fetch_add(1, std::memory_order_relaxed);
+
+    return rc;
+}
+
+void MQTTConnection::publish_acked()
+{
+    m_acked.fetch_add(1, std::memory_order_relaxed);
+
+    // Resent messages after a reconnect may be acked twice, don't go below zero
+    int inflight = m_inflight.load(std::memory_order_relaxed);
+    while (inflight > 0 && !m_inflight.compare_exchange_weak(inflight, inflight - 1, std::memory_order_relaxed));
+
+    // The window just opened up, the publisher may be holding back coalesced messages
+    if (inflight == MQTT_INFLIGHT_WINDOW)
+        m_queue->wake();
+}
+
+void MQTTConnection::publish_flush()
+{
+#ifdef MQTT_USE_EPOLL
+    // The native batch goes out in one write here, the loop checks the socket if it fails
+    if (m_wire)
+        m_wire->flush();
+
+    // Only a publish that didn't fit in the socket needs the loop to watch for writing
+    if (m_wire ? m_wire->wantWrite() : mosquitto_want_write(m_client))
+        wake_loop();
+#endif
+}
+
+int MQTTConnection::connect_native()
+{
+#ifdef MQTT_USE_EPOLL
+    static std::atomic<int> s_connects(0);
+
+    // Unique per process & connection, like the random ID of mosquitto_new
+    std::string clientid = "opcuamqtt/" + std::to_string(getpid()) + "-" + std::to_string(m_index) + "-" + std::to_string(++s_connects);
+    int rc = m_wire->open(m_mqttclient->getHost(), m_mqttclient->getPort(), clientid, 60);
+
+    if (rc > 0)
+    {
+        qDebug() << "MQTT: Connection" << m_index << "refused, CONNACK return code" << rc;
+        m_status = ERROR;
+        return MOSQ_ERR_CONN_REFUSED;
+    }
+
+    if (rc < 0)
+        return MOSQ_ERR_NO_CONN;
+
+    // Nothing sent before the disconnect is acked anymore
+    qDebug() << "MQTT: Connection" << m_index << (m_wire->usesRing() ? "connected (native, io_uring)." : "connected (native).");
+    m_inflight = 0;
+    m_status = CONNECTED;
+    m_queue->wake();
+#endif
+
+    return MOSQ_ERR_SUCCESS;
+}
+
+void MQTTConnection::lost_native()
+{
+#ifdef MQTT_USE_EPOLL
+    qDebug() << "MQTT: Connection" << m_index << "disconnected (Unexpected).";
+
+    m_wire->close();
+    m_watchfd = -1;
+    m_status = m_status == ERROR ? ERROR : DISCONNECTED;
+#endif
+}
+
+void MQTTConnection::stop_publisher()
+{
+    if (m_publisher->getRunState() == RUNNING)
+    {
+        m_publisher->setRunState(STOPPED);
+        m_publisher->wait();
+    }
+}
+
+void MQTTConnection::run()
+{
+    if (m_runstate != NOTSTARTED && m_runstate != FINISHED)
+        return;
+
+    // Delete old instance of the client if it somehow still exists
+    destroy_client();
+
+    // Create client instance with random ID, a native connection has no mosquitto handle
+    if (!isNative())
+        create_client();
+    m_inflight = 0;
+
+    m_runstate = RUNNING;
+
+    // Connect to target server, the error checking has to be done here like this because
+    // connect callback doesn't work at this point.
+    std::string host = m_mqttclient->getHost();
+    qDebug() << "MQTT: Connection" << m_index << "connecting to" << host.c_str() << "...";
+    int valueconnect = isNative() ? connect_native() : mosquitto_connect(m_client, host.c_str(), m_mqttclient->getPort(), 60);
+
+    if (valueconnect != MOSQ_ERR_SUCCESS)
+    {
+        qDebug() << "MQTT: Connection" << m_index << "failed to connect to selected server.";
+        m_runstate = NOTSTARTED;
+        m_status = ERROR;
+        return;
+    }
+
+    m_status = CONNECTED;
+
+    if (m_status != CONNECTED)
+    {
+        m_runstate = NOTSTARTED;
+        return;
+    }
+
+    // Start draining the outbound queue
+    m_publisher->start();
+
+    open_loop();
+
+    // TODO: This could be set to be configurable via GUI
+    int reconnAttempts = 0;
+    int reconnMax = 100;
+
+    // The network loop runs while connected, reconnects are paced apart from it
+    while (m_runstate == RUNNING)
+    {
+        if (m_status == ERROR)
+        {
+            m_runstate = STOPPED;
+        }
+        else if (m_status == DISCONNECTED)
+        {
+            if (reconnAttempts >= reconnMax)
+            {
+                m_runstate = STOPPED;
+                continue;
+            }
+
+            qDebug() << "MQTT: Connection" << m_index << "disconnected from server! Attempting to reconnect, attempts: " << reconnAttempts << "/" << reconnMax;
+            reconnAttempts++;
+
+            if ((isNative() ? connect_native() : mosquitto_reconnect(m_client)) != MOSQ_ERR_SUCCESS)
+            {
+                msleep(MQTT_RECONNECT_DELAY);
+                continue;
+            }
+
+            // The connect callback sets the status once the broker accepts
+            for (int i = 0; i < 10 && m_status == DISCONNECTED && m_runstate == RUNNING && !isNative() && mosquitto_socket(m_client) >= 0; i++)
+                loop_events();
+        }
+        else
+        {
+            reconnAttempts = 0;
+            loop_events();
+        }
+    }
+
+    // The publisher wakes the loop, it has to be gone before the eventfd is
+    stop_publisher();
+    close_loop();
+    destroy_client();
+    m_status = m_status == ERROR ? ERROR : DISCONNECTED;
+    m_runstate = FINISHED;
+    qDebug() << "MQTT: Connection" << m_index << "disconnecting from server...";
+}
+
+void MQTTConnection::open_loop()
+{
+#ifdef MQTT_USE_EPOLL
+    m_epollfd = epoll_create1(EPOLL_CLOEXEC);
+    m_watchfd = -1;
+    m_watchout = false;
+
+    std::lock_guard<std::mutex> lock(m_wakemutex);
+    m_wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = m_wakefd;
+    epoll_ctl(m_epollfd, EPOLL_CTL_ADD, m_wakefd, &ev);
+#endif
+}
+
+void MQTTConnection::close_loop()
+{
+#ifdef MQTT_USE_EPOLL
+    {
+        std::lock_guard<std::mutex> lock(m_wakemutex);
+
+        if (m_wakefd >= 0)
+            ::close(m_wakefd);
+
+        m_wakefd = -1;
+    }
+
+    if (m_epollfd >= 0)
+        ::close(m_epollfd);
+
+    m_epollfd = -1;
+    m_watchfd = -1;
+#endif
+}
+
+void MQTTConnection::wake_loop()
+{
+#ifdef MQTT_USE_EPOLL
+    // Never a write to an eventfd number that has been closed & maybe reused
+    std::lock_guard<std::mutex> lock(m_wakemutex);
+
+    if (m_wakefd >= 0)
+    {
+        uint64_t one = 1;
+        ssize_t rc = ::write(m_wakefd, &one, sizeof(one));
+        (void) rc;
+    }
+#endif
+}
+
+void MQTTConnection::loop_events()
+{
+#ifdef MQTT_USE_EPOLL
+    int fd = m_wire ? m_wire->getSocket() : mosquitto_socket(m_client);
+    if (fd < 0)
+    {
+        m_watchfd = -1;
+        m_status = m_status == ERROR ? ERROR : DISCONNECTED;
+        return;
+    }
+
+    // A closed socket leaves the set by itself, a reconnect may get the same number back
+    bool wantout = m_wire ? m_wire->wantWrite() : mosquitto_want_write(m_client);
+    if (fd != m_watchfd || wantout != m_watchout)
+    {
+        epoll_event ev = {};
+        ev.events = EPOLLIN | (wantout ? EPOLLOUT : 0);
+        ev.data.fd = fd;
+
+        int first = fd == m_watchfd ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        if (epoll_ctl(m_epollfd, first, fd, &ev) != 0)
+            epoll_ctl(m_epollfd, first == EPOLL_CTL_MOD ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &ev);
+
+        m_watchfd = fd;
+        m_watchout = wantout;
+    }
+
+    epoll_event events[2];
+    int n = epoll_wait(m_epollfd, events, 2, MQTT_LOOP_TIMEOUT);
+    m_wakeups.fetch_add(1, std::memory_order_relaxed);
+
+    int rc = MOSQ_ERR_SUCCESS;
+    for (int i = 0; i < n; i++)
+    {
+        if (events[i].data.fd == m_wakefd)
+        {
+            uint64_t count;
+            ssize_t len = ::read(m_wakefd, &count, sizeof(count));
+            (void) len;
+            continue;
+        }
+
+        if (m_wire)
+        {
+            rc = loop_native(events[i].events);
+            continue;
+        }
+
+        // Every packet that has arrived is read, PUBACKs come in bursts
+        if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+            rc = mosquitto_loop_read(m_client, 1);
+
+        if (rc == MOSQ_ERR_SUCCESS && (events[i].events & EPOLLOUT))
+            rc = mosquitto_loop_write(m_client, 1);
+    }
+
+    // Keepalive pings & retries, cheap when there's nothing due
+    if (rc == MOSQ_ERR_SUCCESS)
+        rc = m_wire ? (m_wire->keepalive() ? MOSQ_ERR_SUCCESS : MOSQ_ERR_CONN_LOST) : mosquitto_loop_misc(m_client);
+
+    if (m_wire && rc != MOSQ_ERR_SUCCESS)
+    {
+        lost_native();
+        return;
+    }
+
+    if (rc == MOSQ_ERR_NO_CONN || rc == MOSQ_ERR_CONN_LOST)
+        m_status = m_status == ERROR ? ERROR : DISCONNECTED;
+#else
+    mosquitto_loop(m_client, -1, 1);
+#endif
+}
+
+int MQTTConnection::loop_native(uint32_t events)
+{
+#ifdef MQTT_USE_EPOLL
+    if (events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+    {
+        int acks = m_wire->read();
+        if (acks < 0)
+            return MOSQ_ERR_CONN_LOST;
+
+        for (int i = 0; i < acks; i++)
+            publish_acked();
+    }
+
+    if (events & EPOLLOUT)
+    {
+        if (!m_wire->flush())
+            return MOSQ_ERR_CONN_LOST;
+
+        // The publisher holds back while the send buffers are all taken
+        m_queue->wake();
+    }
+#else
+    (void) events;
+#endif
+
+    return MOSQ_ERR_SUCCESS;
+}
+
+void MQTTConnection::setRunState(const CLIENT_STATE state)
+{
+    m_runstate = state;
+
+    // Don't leave a stop waiting for the loop timeout
+    wake_loop();
+}
+
+void MQTTConnection::setStatus(const CLIENT_STATUS status)
+{
+    m_status = status;
+}
+
+int MQTTConnection::getIndex() const
+{
+    return m_index;
+}
+
+CLIENT_STATE MQTTConnection::getRunState() const
+{
+    return m_runstate;
+}
+
+CLIENT_STATUS MQTTConnection::getStatus() const
+{
+    return m_status;
+}
+
+MQTTQueue *MQTTConnection::getQueue() const
+{
+    return m_queue;
+}
+
+MQTTPublisher *MQTTConnection::getPublisher() const
+{
+    return m_publisher;
+}
+
+int MQTTConnection::getInflight() const
+{
+    return m_inflight.load(std::memory_order_relaxed);
+}
+
+uint64_t MQTTConnection::getAcked() const
+{
+    return m_acked.load(std::memory_order_relaxed);
+}
+
+#ifdef MQTT_USE_EPOLL
+MQTTWire *MQTTConnection::getWire() const
+{
+    return m_wire;
+}
+#endif
+
+bool MQTTConnection::isNative() const
+{
+#ifdef MQTT_USE_EPOLL
+    return m_wire != nullptr;
+#else
+    return false;
+#endif
+}
+
+uint64_t MQTTConnection::getWakeups() const
+{
+    return m_wakeups.load(std::memory_order_relaxed);
+}
+
+bool MQTTConnection::canPublish() const
+{
+#ifdef MQTT_USE_EPOLL
+    // A native connection also holds back while its send buffers are all taken
+    if (m_wire && m_wire->isFull())
+        return false;
+#endif
+
+    return m_status == CONNECTED && getInflight() < MQTT_INFLIGHT_WINDOW;
+}
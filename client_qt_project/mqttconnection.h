@@ -0,0 +1,106 @@
+#ifndef MQTTCONNECTION_H
+#define MQTTCONNECTION_H
+
+#include <QThread>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <mosquitto.h>
+#include "clientstates.h"
+#include "config.h"
+#include "mqttwire.h"
+
+class MQTTClient;
+class MQTTQueue;
+class MQTTPublisher;
+class MQTTBatcher;
+struct MQTTMessage;
+
+// --------------------------------------------------------
+// Callback functions below
+// --------------------------------------------------------
+void on_connect(struct mosquitto *mosq, void *obj, int rc);
+void on_disconnect(struct mosquitto *mosq, void *obj, int rc);
+void on_publish(struct mosquitto *mosq, void *obj, int rc);
+void on_message(struct mosquitto *mosq, void *obj, const struct mosquitto_message *message);
+void on_subscribe(struct mosquitto *mosq, void *obj, int mid, int qos_count, const int *granted_qos);
+void on_unsubscribe(struct mosquitto *mosq, void *obj, int mid);
+void on_log(struct mosquitto *mosq, void *obj, int level, const char *str);
+
+// --------------------------------------------------------
+// MQTTConnection class, one broker connection of the MQTT client
+// Owns a mosquitto handle, its outbound queue & publisher thread and
+// its own inflight window. The thread runs the network loop & reconnects,
+// host & port are taken from the client when it's started.
+// With MQTT_USE_EPOLL the loop sleeps in epoll_wait on the mosquitto socket
+// and an eventfd. Reads drain every available packet, the socket is only
+// watched for writing while mosquitto has unsent data, and the publisher
+// wakes the loop through the eventfd when a publish couldn't be sent whole.
+// Idle, the thread only wakes for the keepalive every MQTT_LOOP_TIMEOUT ms.
+// A native connection talks MQTT itself through an MQTTWire instead of a
+// mosquitto handle, it needs the epoll loop & is libmosquitto elsewhere.
+// --------------------------------------------------------
+class MQTTConnection : public QThread
+{
+    Q_OBJECT
+
+public:
+    MQTTConnection(MQTTClient *client = nullptr, int index = 0, MQTTBatcher *batcher = nullptr, bool native = false);
+    ~MQTTConnection();
+
+    void create_client();
+    void destroy_client();
+    int publish_raw(const MQTTMessage &msg);
+    void publish_acked();
+    void publish_flush();
+    void setRunState(const CLIENT_STATE state);
+    void setStatus(const CLIENT_STATUS status);
+    int getIndex() const;
+    CLIENT_STATE getRunState() const;
+    CLIENT_STATUS getStatus() const;
+    MQTTQueue *getQueue() const;
+    MQTTPublisher *getPublisher() const;
+#ifdef MQTT_USE_EPOLL
+    MQTTWire *getWire() const;
+#endif
+    bool isNative() const;
+    int getInflight() const;
+    uint64_t getAcked() const;
+    uint64_t getWakeups() const;
+    bool canPublish() const;
+
+private:
+    void stop_publisher();
+    int connect_native();
+    void lost_native();
+    int loop_native(uint32_t events);
+    void loop_events();
+    void open_loop();
+    void close_loop();
+    void wake_loop();
+
+    MQTTClient *m_mqttclient;
+    int m_index;
+    mosquitto *m_client;
+#ifdef MQTT_USE_EPOLL
+    MQTTWire *m_wire; // native connection, nullptr with libmosquitto
+#endif
+    MQTTQueue *m_queue;
+    MQTTPublisher *m_publisher;
+    volatile CLIENT_STATE m_runstate;
+    volatile CLIENT_STATUS m_status;
+    std::atomic<int> m_inflight;
+    std::atomic<uint64_t> m_acked;
+    std::atomic<uint64_t> m_wakeups;
+    int m_epollfd;
+    int m_wakefd;
+    std::mutex m_wakemutex; // m_wakefd, written by the publisher & stop
+    int m_watchfd;   // mosquitto socket in the epoll set
+    bool m_watchout; // watched for writing too
+
+protected:
+    void run() override;
+
+};
+
+#endif // MQTTCONNECTION_H
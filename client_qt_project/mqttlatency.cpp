@@ -0,0 +1,71 @@
+#include "mqttlatency.h"
+#include <chrono>
+
+// --------------------------------------------------------
+// Publish latency histogram class below
+// --------------------------------------------------------
+MQTTLatency::MQTTLatency() :
+    m_count(0)
+{
+    for (int i = 0; i < s_buckets; i++)
+        m_counts[i] = 0;
+}
+
+void MQTTLatency::record(uint64_t us)
+{
+    m_counts[bucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t MQTTLatency::getCount() const
+{
+    return m_count.load(std::memory_order_relaxed);
+}
+
+uint64_t MQTTLatency::getPercentile(double p) const
+{
+    uint64_t count = getCount();
+    if (count == 0)
+        return 0;
+
+    // Upper bound of the bucket the p-th sample falls in
+    uint64_t rank = static_cast<uint64_t>(p * count);
+    uint64_t seen = 0;
+    for (int i = 0; i < s_buckets; i++)
+    {
+        seen += m_counts[i].load(std::memory_order_relaxed);
+        if (seen > rank)
+            return upperOf(i);
+    }
+
+    return upperOf(s_buckets - 1);
+}
+
+int64_t MQTTLatency::now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int MQTTLatency::bucketOf(uint64_t us)
+{
+    // Values below 4 have their own buckets, above that the top bit & the two after it
+    if (us < 4)
+        return static_cast<int>(us);
+
+    int msb = 63;
+    while (!(us >> msb))
+        msb--;
+
+    return msb * 4 + static_cast<int>((us >> (msb - 2)) & 3);
+}
+
+uint64_t MQTTLatency::upperOf(int bucket)
+{
+    if (bucket < 4)
+        return static_cast<uint64_t>(bucket);
+
+    int msb = bucket / 4;
+    uint64_t sub = static_cast<uint64_t>(bucket % 4);
+
+    return ((4 + sub + 1) << (msb - 2)) - 1;
+}
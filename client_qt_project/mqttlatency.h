@@ -0,0 +1,35 @@
+#ifndef MQTTLATENCY_H
+#define MQTTLATENCY_H
+
+#include <atomic>
+#include <cstdint>
+
+// --------------------------------------------------------
+// MQTTLatency class, histogram of publish latencies in microseconds
+// Buckets are powers of two split in four, so a percentile is off by at
+// most a quarter of its power of two. One thread records, any thread
+// may read, all counters are relaxed atomics.
+// --------------------------------------------------------
+class MQTTLatency
+{
+
+public:
+    MQTTLatency();
+
+    void record(uint64_t us);
+    uint64_t getCount() const;
+    uint64_t getPercentile(double p) const;
+    static int64_t now();
+
+private:
+    static const int s_buckets = 64 * 4;
+
+    static int bucketOf(uint64_t us);
+    static uint64_t upperOf(int bucket);
+
+    std::atomic<uint64_t> m_counts[s_buckets];
+    std::atomic<uint64_t> m_count;
+
+};
+
+#endif // MQTTLATENCY_H
@@ -0,0 +1,123 @@
+#include "mqttpublisher.h"
+#include "mqttconnection.h"
+#include "mqttqueue.h"
+#include "mqttbatcher.h"
+#include <QDebug>
+
+// --------------------------------------------------------
+// MQTTPublisher class below
+// --------------------------------------------------------
+MQTTPublisher::MQTTPublisher(MQTTConnection *connection, MQTTQueue *queue, MQTTBatcher *batcher, int batch) :
+    m_connection(connection),
+    m_queue(queue),
+    m_batcher(batcher),
+    m_batch(batch > 0 ? batch : 1),
+    m_runstate(NOTSTARTED),
+    m_published(0),
+    m_failed(0),
+    m_batches(0),
+    m_coalesced(0),
+    m_coalescer(MQTT_QUEUE_SIZE),
+    m_latency()
+{
+
+}
+
+void MQTTPublisher::run()
+{
+    m_runstate = RUNNING;
+
+    while (m_runstate == RUNNING)
+    {
+        int timeout = m_batcher ? m_batcher->flushExpired() : -1;
+
+        // Woken by new messages, a reconnect, a PUBACK opening the window, free send
+        // buffers or a stop. Idle it sleeps, only an open batch frame sets a deadline
+        m_queue->wait(timeout);
+
+        // Held back messages go first, in their original order
+        int held = 0;
+        while (!m_coalescer.empty() && m_connection->canPublish())
+        {
+            publish(*m_coalescer.front());
+            m_coalescer.pop();
+            held++;
+        }
+
+        // Publish up to one batch, then check the run state again
+        int n = 0;
+        MQTTMessage *msg;
+        while (n < m_batch && (msg = m_queue->front()) != nullptr)
+        {
+            if (m_coalescer.empty() && m_connection->canPublish())
+                publish(*msg);
+            else
+                m_coalescer.put(*msg);
+
+            m_queue->pop();
+            n++;
+        }
+
+        if (n + held > 0)
+            m_connection->publish_flush();
+
+        if (n > 0)
+            m_batches.fetch_add(1, std::memory_order_relaxed);
+
+        m_coalesced.store(m_coalescer.getReplaced(), std::memory_order_relaxed);
+    }
+
+    qDebug() << "MQTT: Publisher stopped, published" << (unsigned long long) getPublished() << "failed" << (unsigned long long) getFailed()
+             << "batches" << (unsigned long long) getBatches() << "dropped" << (unsigned long long) m_queue->getDropped()
+             << "contention" << (unsigned long long) m_queue->getContention() << "coalesced" << (unsigned long long) getCoalesced()
+             << "pending" << (unsigned long long) m_coalescer.getPending() << "events dropped" << (unsigned long long) m_coalescer.getDropped();
+
+    m_runstate = FINISHED;
+}
+
+void MQTTPublisher::publish(const MQTTMessage &msg)
+{
+    if (m_connection->publish_raw(msg) == MOSQ_ERR_SUCCESS)
+    {
+        m_published.fetch_add(1, std::memory_order_relaxed);
+        m_latency.record(static_cast<uint64_t>(MQTTLatency::now() - msg.queued));
+    }
+    else
+        m_failed.fetch_add(1, std::memory_order_relaxed);
+}
+
+void MQTTPublisher::setRunState(const CLIENT_STATE state)
+{
+    m_runstate = state;
+    m_queue->wake();
+}
+
+CLIENT_STATE MQTTPublisher::getRunState() const
+{
+    return m_runstate;
+}
+
+uint64_t MQTTPublisher::getPublished() const
+{
+    return m_published.load(std::memory_order_relaxed);
+}
+
+uint64_t MQTTPublisher::getFailed() const
+{
+    return m_failed.load(std::memory_order_relaxed);
+}
+
+uint64_t MQTTPublisher::getBatches() const
+{
+    return m_batches.load(std::memory_order_relaxed);
+}
+
+uint64_t MQTTPublisher::getCoalesced() const
+{
+    return m_coalesced.load(std::memory_order_relaxed);
+}
+
+const MQTTLatency &MQTTPublisher::getLatency() const
+{
+    return m_latency;
+}
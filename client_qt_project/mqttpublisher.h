@@ -0,0 +1,59 @@
+#ifndef MQTTPUBLISHER_H
+#define MQTTPUBLISHER_H
+
+#include <QThread>
+#include <atomic>
+#include <cstdint>
+#include "clientstates.h"
+#include "mqttcoalescer.h"
+#include "mqttlatency.h"
+
+class MQTTConnection;
+class MQTTQueue;
+class MQTTBatcher;
+
+// --------------------------------------------------------
+// MQTTPublisher class, drains the outbound queue in batches
+// One per broker connection. Keeps broker writes off the OPC UA publish threads, and closes the
+// batcher frames whose time window has passed. While the broker is
+// disconnected or the inflight window is full, messages wait in the
+// coalescer where only the latest value per topic is kept.
+// The latency from the push into the queue to the hand over to the
+// connection is recorded per published message.
+// --------------------------------------------------------
+class MQTTPublisher : public QThread
+{
+    Q_OBJECT
+
+public:
+    MQTTPublisher(MQTTConnection *connection = nullptr, MQTTQueue *queue = nullptr, MQTTBatcher *batcher = nullptr, int batch = 64);
+
+    void setRunState(const CLIENT_STATE state);
+    CLIENT_STATE getRunState() const;
+    uint64_t getPublished() const;
+    uint64_t getFailed() const;
+    uint64_t getBatches() const;
+    uint64_t getCoalesced() const;
+    const MQTTLatency &getLatency() const;
+
+private:
+    void publish(const MQTTMessage &msg);
+
+    MQTTConnection *m_connection;
+    MQTTQueue *m_queue;
+    MQTTBatcher *m_batcher;
+    int m_batch;
+    volatile CLIENT_STATE m_runstate;
+    std::atomic<uint64_t> m_published;
+    std::atomic<uint64_t> m_failed;
+    std::atomic<uint64_t> m_batches;
+    std::atomic<uint64_t> m_coalesced;
+    MQTTCoalescer m_coalescer;
+    MQTTLatency m_latency;
+
+protected:
+    void run() override;
+
+};
+
+#endif // MQTTPUBLISHER_H
@@ -0,0 +1,172 @@
+#include "mqttqueue.h"
+#include "mqttlatency.h"
+#include <cstring>
+#include <chrono>
+
+// --------------------------------------------------------
+// MQTTQueue class below
+// --------------------------------------------------------
+MQTTQueue::MQTTQueue(size_t size) :
+    m_slots(nullptr),
+    m_mask(0),
+    m_tail(0),
+    m_head(0),
+    m_waiting(false),
+    m_signalled(false),
+    m_pushed(0),
+    m_dropped(0),
+    m_oversized(0),
+    m_contention(0)
+{
+    // Round up to a power of two so the index is a mask
+    size_t capacity = 2;
+    while (capacity < size)
+        capacity <<= 1;
+
+    m_slots = new Slot[capacity];
+    m_mask = capacity - 1;
+
+    for (size_t i = 0; i < capacity; i++)
+        m_slots[i].seq.store(i, std::memory_order_relaxed);
+}
+
+MQTTQueue::~MQTTQueue()
+{
+    delete[] m_slots;
+}
+
+bool MQTTQueue::push(const std::string &topic, const char *payload, size_t payloadlen, bool keepall)
+{
+    if (topic.size() > MQTT_MSG_TOPIC_MAX || payloadlen > MQTT_MSG_PAYLOAD_MAX)
+    {
+        m_oversized.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    Slot *slot = nullptr;
+    size_t pos = m_tail.load(std::memory_order_relaxed);
+
+    for (;;)
+    {
+        slot = &m_slots[pos & m_mask];
+        size_t seq = slot->seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+
+        if (diff == 0)
+        {
+            if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+
+            // Lost the slot to another producer
+            m_contention.fetch_add(1, std::memory_order_relaxed);
+        }
+        else if (diff < 0)
+        {
+            // Consumer hasn't released this slot yet, queue is full
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        else
+        {
+            pos = m_tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->msg.topiclen = (uint32_t) topic.size();
+    slot->msg.payloadlen = (uint32_t) payloadlen;
+    slot->msg.keepall = keepall;
+    slot->msg.queued = MQTTLatency::now();
+    std::memcpy(slot->msg.topic, topic.data(), topic.size());
+    slot->msg.topic[topic.size()] = '\0';
+    std::memcpy(slot->msg.payload, payload, payloadlen);
+    slot->seq.store(pos + 1, std::memory_order_release);
+
+    m_pushed.fetch_add(1, std::memory_order_relaxed);
+
+    // Pairs with the store of m_waiting in wait(), either we see the waiter or it sees the slot
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_waiting.load(std::memory_order_relaxed))
+        wake();
+
+    return true;
+}
+
+MQTTMessage *MQTTQueue::front()
+{
+    size_t pos = m_head.load(std::memory_order_relaxed);
+    Slot *slot = &m_slots[pos & m_mask];
+
+    if (slot->seq.load(std::memory_order_acquire) != pos + 1)
+        return nullptr;
+
+    return &slot->msg;
+}
+
+void MQTTQueue::pop()
+{
+    size_t pos = m_head.load(std::memory_order_relaxed);
+    Slot *slot = &m_slots[pos & m_mask];
+
+    // Hand the slot back to the producers one lap later
+    slot->seq.store(pos + m_mask + 1, std::memory_order_release);
+    m_head.store(pos + 1, std::memory_order_relaxed);
+}
+
+bool MQTTQueue::wait(int timeoutms)
+{
+    std::unique_lock<std::mutex> lock(m_waitmutex);
+
+    m_waiting.store(true, std::memory_order_seq_cst);
+
+    // Recheck after announcing, a producer may have pushed in between. A negative timeout waits until woken
+    auto ready = [this]() { return m_signalled || front() != nullptr; };
+    if (timeoutms < 0)
+        m_waitcond.wait(lock, ready);
+    else
+        m_waitcond.wait_for(lock, std::chrono::milliseconds(timeoutms), ready);
+
+    m_signalled = false;
+    m_waiting.store(false, std::memory_order_relaxed);
+
+    return front() != nullptr;
+}
+
+void MQTTQueue::wake()
+{
+    std::lock_guard<std::mutex> lock(m_waitmutex);
+    m_signalled = true;
+    m_waitcond.notify_one();
+}
+
+size_t MQTTQueue::getSize() const
+{
+    size_t head = m_head.load(std::memory_order_relaxed);
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+
+    return tail - head;
+}
+
+size_t MQTTQueue::getCapacity() const
+{
+    return m_mask + 1;
+}
+
+uint64_t MQTTQueue::getPushed() const
+{
+    return m_pushed.load(std::memory_order_relaxed);
+}
+
+uint64_t MQTTQueue::getDropped() const
+{
+    return m_dropped.load(std::memory_order_relaxed);
+}
+
+uint64_t MQTTQueue::getOversized() const
+{
+    return m_oversized.load(std::memory_order_relaxed);
+}
+
+uint64_t MQTTQueue::getContention() const
+{
+    return m_contention.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,82 @@
+#ifndef MQTTQUEUE_H
+#define MQTTQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include "config.h"
+
+// --------------------------------------------------------
+// Pre-encoded outbound message, lives in a queue slot
+// --------------------------------------------------------
+struct MQTTMessage
+{
+    uint32_t topiclen;
+    uint32_t payloadlen;
+    bool keepall; // never coalesced, every sample counts
+    int64_t queued; // push time, MQTTLatency::now
+    char topic[MQTT_MSG_TOPIC_MAX + 1]; // null terminated
+    char payload[MQTT_MSG_PAYLOAD_MAX];
+};
+
+// --------------------------------------------------------
+// MQTTQueue class, bounded multi producer single consumer ring
+// Producers (OPC UA callback threads) claim a slot with a CAS on the
+// tail and publish it through the slot sequence number, the single
+// consumer (publisher thread) reads slots in place and releases them.
+// A full queue drops the new message instead of blocking the producer.
+// The consumer sleeps without a timeout, a producer only signals when it
+// has seen the consumer waiting on an empty queue. wake() is remembered
+// until the next wait, so a wake just before it isn't lost.
+// --------------------------------------------------------
+class MQTTQueue
+{
+
+public:
+    MQTTQueue(size_t size = MQTT_QUEUE_SIZE);
+    ~MQTTQueue();
+
+    bool push(const std::string &topic, const char *payload, size_t payloadlen, bool keepall = false);
+    MQTTMessage *front();
+    void pop();
+    bool wait(int timeoutms);
+    void wake();
+    size_t getSize() const;
+    size_t getCapacity() const;
+    uint64_t getPushed() const;
+    uint64_t getDropped() const;
+    uint64_t getOversized() const;
+    uint64_t getContention() const;
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> seq;
+        MQTTMessage msg;
+    };
+
+    MQTTQueue(const MQTTQueue &) = delete;
+    MQTTQueue &operator=(const MQTTQueue &) = delete;
+
+    Slot *m_slots;
+    size_t m_mask;
+    char m_pad0[64];
+    std::atomic<size_t> m_tail; // producers
+    char m_pad1[64];
+    std::atomic<size_t> m_head; // consumer
+    char m_pad2[64];
+    std::atomic<bool> m_waiting;
+    std::mutex m_waitmutex;
+    std::condition_variable m_waitcond;
+    bool m_signalled; // by m_waitmutex
+    std::atomic<uint64_t> m_pushed;
+    std::atomic<uint64_t> m_dropped;
+    std::atomic<uint64_t> m_oversized;
+    std::atomic<uint64_t> m_contention;
+
+};
+
+#endif // MQTTQUEUE_H
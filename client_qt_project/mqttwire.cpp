@@ -0,0 +1,636 @@
+#include "mqttwire.h"
+#include "mqttqueue.h"
+#include <QDebug>
+#include <cerrno>
+#include <cstring>
+
+#ifdef MQTT_USE_EPOLL
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifdef MQTT_USE_IO_URING
+#include <liburing.h>
+#endif
+
+namespace
+{
+
+// Fixed header bytes, PUBLISH is QoS 1 & retained like the libmosquitto path
+const char s_connect = 0x10;
+const char s_publish = 0x33;
+const uint8_t s_connack = 0x20;
+const uint8_t s_puback = 0x40;
+const uint8_t s_pingresp = 0xD0;
+
+// Fixed header (at most 5 bytes), topic & packet id lengths around the slot
+const size_t s_maxpacket = 5 + 2 + MQTT_MSG_TOPIC_MAX + 2 + MQTT_MSG_PAYLOAD_MAX;
+
+}
+
+// --------------------------------------------------------
+// MQTTWire class below
+// --------------------------------------------------------
+MQTTWire::MQTTWire(size_t buffers, size_t buffersize) :
+    m_socket(-1),
+    m_keepalive(60),
+    m_mid(0),
+    m_buffers(std::vector<Buffer>(buffers > 1 ? buffers : 2)),
+    m_ring(nullptr),
+    m_head(0),
+    m_tail(0),
+    m_submitted(false),
+    m_session(0),
+    m_inbuf(std::vector<char>(4096)),
+    m_inlen(0),
+    m_lastsend(std::chrono::steady_clock::now()),
+    m_pingsent(std::chrono::steady_clock::now()),
+    m_pingpending(false),
+    m_packets(0),
+    m_writes(0)
+{
+    for (Buffer &buffer : m_buffers)
+    {
+        buffer.data.resize(buffersize > s_maxpacket ? buffersize : s_maxpacket);
+        buffer.len = 0;
+        buffer.sent = 0;
+    }
+
+    openRing();
+}
+
+MQTTWire::~MQTTWire()
+{
+    close();
+    closeRing();
+}
+
+int MQTTWire::open(const std::string &host, int port, const std::string &clientid, int keepalive)
+{
+    close();
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo *addrs = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addrs) != 0)
+    {
+        qDebug() << "MQTT: Can't resolve" << host.c_str();
+        return -1;
+    }
+
+    // The publisher only sees the socket once the broker has accepted
+    int fd = -1;
+    for (addrinfo *addr = addrs; addr != nullptr && fd < 0; addr = addr->ai_next)
+    {
+        fd = socket(addr->ai_family, addr->ai_socktype | SOCK_CLOEXEC, addr->ai_protocol);
+        if (fd >= 0 && !connectTimed(fd, addr->ai_addr, addr->ai_addrlen, MQTT_WIRE_CONNECT_TIMEOUT))
+        {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addrs);
+
+    if (fd < 0)
+        return -1;
+
+    // Packets are flushed in batches already, Nagle would only hold the last one back
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    // CONNECT: protocol "MQTT" level 4, clean session, keepalive, client id
+    std::vector<char> packet;
+    size_t remaining = 10 + 2 + clientid.size();
+    char header[5];
+    header[0] = s_connect;
+    size_t headerlen = 1 + encodeLength(header + 1, remaining);
+    packet.insert(packet.end(), header, header + headerlen);
+
+    const char variable[10] = { 0, 4, 'M', 'Q', 'T', 'T', 4, 0x02, (char) (keepalive >> 8), (char) (keepalive & 0xFF) };
+    packet.insert(packet.end(), variable, variable + sizeof(variable));
+    packet.push_back((char) (clientid.size() >> 8));
+    packet.push_back((char) (clientid.size() & 0xFF));
+    packet.insert(packet.end(), clientid.begin(), clientid.end());
+
+    // The handshake is blocking, with a timeout in case the broker never answers
+    timeval timeout = { 10, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    uint8_t connack[4];
+    size_t got = 0;
+    bool ok = writeAll(fd, packet.data(), packet.size());
+    while (ok && got < sizeof(connack))
+    {
+        ssize_t n = recv(fd, connack + got, sizeof(connack) - got, 0);
+        ok = n > 0;
+        got += ok ? (size_t) n : 0;
+    }
+
+    if (!ok || connack[0] != s_connack || connack[1] != 2 || connack[3] != 0)
+    {
+        ::close(fd);
+        return ok && connack[0] == s_connack ? connack[3] : -1;
+    }
+
+    timeval none = { 0, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &none, sizeof(none));
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    std::lock_guard<std::mutex> lock(m_sendmutex);
+    m_socket = fd;
+    m_keepalive = keepalive;
+    m_lastsend = std::chrono::steady_clock::now();
+    m_pingpending = false;
+
+    return 0;
+}
+
+void MQTTWire::close()
+{
+    std::lock_guard<std::mutex> lock(m_sendmutex);
+
+    if (m_socket >= 0)
+        ::close(m_socket);
+
+    m_socket = -1;
+
+    // Whatever wasn't written is gone with the connection
+    for (Buffer &buffer : m_buffers)
+    {
+        buffer.len = 0;
+        buffer.sent = 0;
+    }
+
+    m_head = 0;
+    m_tail = 0;
+    m_inlen = 0;
+    m_session++;
+}
+
+bool MQTTWire::publish(const MQTTMessage &msg)
+{
+    std::lock_guard<std::mutex> lock(m_sendmutex);
+
+    size_t remaining = 2 + msg.topiclen + 2 + msg.payloadlen;
+    char header[5];
+    header[0] = s_publish;
+    size_t headerlen = 1 + encodeLength(header + 1, remaining);
+
+    if (m_socket < 0 || !reserve(headerlen + remaining))
+        return false;
+
+    if (++m_mid == 0)
+        m_mid = 1;
+
+    Buffer &buffer = m_buffers[m_tail];
+    char *out = buffer.data.data() + buffer.len;
+
+    std::memcpy(out, header, headerlen);
+    out += headerlen;
+    *out++ = (char) (msg.topiclen >> 8);
+    *out++ = (char) (msg.topiclen & 0xFF);
+    std::memcpy(out, msg.topic, msg.topiclen);
+    out += msg.topiclen;
+    *out++ = (char) (m_mid >> 8);
+    *out++ = (char) (m_mid & 0xFF);
+    std::memcpy(out, msg.payload, msg.payloadlen);
+
+    buffer.len += headerlen + remaining;
+    m_packets.fetch_add(1, std::memory_order_relaxed);
+
+    return true;
+}
+
+bool MQTTWire::flush()
+{
+    std::unique_lock<std::mutex> lock(m_sendmutex);
+
+    return flushLocked(lock);
+}
+
+int MQTTWire::read()
+{
+    if (m_socket < 0)
+        return -1;
+
+    // Drain the socket, PUBACKs of a whole batch tend to arrive together
+    int acks = 0;
+    for (;;)
+    {
+        ssize_t n = recv(m_socket, m_inbuf.data() + m_inlen, m_inbuf.size() - m_inlen, 0);
+        if (n == 0)
+            return -1;
+
+        if (n < 0)
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? acks : -1;
+
+        m_inlen += (size_t) n;
+
+        size_t pos = 0;
+        while (m_inlen - pos >= 2)
+        {
+            const uint8_t *packet = reinterpret_cast<const uint8_t *>(m_inbuf.data() + pos);
+
+            size_t remaining = 0;
+            size_t lenbytes = 0;
+            bool complete = false;
+            while (1 + lenbytes < m_inlen - pos && lenbytes < 4)
+            {
+                uint8_t byte = packet[1 + lenbytes];
+                remaining |= (size_t) (byte & 0x7F) << (7 * lenbytes);
+                lenbytes++;
+
+                if ((byte & 0x80) == 0)
+                {
+                    complete = true;
+                    break;
+                }
+            }
+
+            // A broker only sends small packets to a publisher, anything else is a protocol error
+            if (!complete && lenbytes == 4)
+                return -1;
+
+            size_t total = 1 + lenbytes + remaining;
+            if (total > m_inbuf.size())
+                return -1;
+
+            if (!complete || m_inlen - pos < total)
+                break;
+
+            if (packet[0] == s_puback)
+                acks++;
+            else if (packet[0] == s_pingresp)
+                m_pingpending = false;
+
+            pos += total;
+        }
+
+        std::memmove(m_inbuf.data(), m_inbuf.data() + pos, m_inlen - pos);
+        m_inlen -= pos;
+    }
+}
+
+bool MQTTWire::keepalive()
+{
+    std::unique_lock<std::mutex> lock(m_sendmutex);
+
+    if (m_socket < 0)
+        return false;
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::chrono::seconds interval(m_keepalive);
+
+    // No PINGRESP within another keepalive interval, the broker is gone
+    if (m_pingpending && now - m_pingsent > interval)
+        return false;
+
+    if (!m_pingpending && now - m_lastsend >= interval)
+    {
+        if (!reserve(2))
+            return flushLocked(lock);
+
+        Buffer &buffer = m_buffers[m_tail];
+        buffer.data[buffer.len++] = (char) 0xC0;
+        buffer.data[buffer.len++] = 0;
+
+        m_pingpending = true;
+        m_pingsent = now;
+    }
+
+    return flushLocked(lock);
+}
+
+int MQTTWire::getSocket() const
+{
+    return m_socket;
+}
+
+bool MQTTWire::wantWrite()
+{
+    std::lock_guard<std::mutex> lock(m_sendmutex);
+
+    // The flush reaping a ring batch takes care of what's left after it
+    return !m_submitted && m_buffers[m_head].len > m_buffers[m_head].sent;
+}
+
+bool MQTTWire::isFull()
+{
+    std::lock_guard<std::mutex> lock(m_sendmutex);
+
+    const Buffer &buffer = m_buffers[m_tail];
+    size_t next = (m_tail + 1) % m_buffers.size();
+
+    return buffer.len + s_maxpacket > buffer.data.size() && (next == m_head || m_buffers[next].len > 0);
+}
+
+bool MQTTWire::usesRing() const
+{
+    return m_ring != nullptr;
+}
+
+uint64_t MQTTWire::getPackets() const
+{
+    return m_packets.load(std::memory_order_relaxed);
+}
+
+uint64_t MQTTWire::getWrites() const
+{
+    return m_writes.load(std::memory_order_relaxed);
+}
+
+bool MQTTWire::reserve(size_t len)
+{
+    Buffer &buffer = m_buffers[m_tail];
+    if (buffer.len + len <= buffer.data.size())
+        return true;
+
+    // Move on to the next buffer if it has been written out
+    size_t next = (m_tail + 1) % m_buffers.size();
+    if (next == m_head || m_buffers[next].len > 0 || len > m_buffers[next].data.size())
+        return false;
+
+    m_tail = next;
+    return true;
+}
+
+bool MQTTWire::writeAll(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+
+        data += n;
+        len -= (size_t) n;
+    }
+
+    return true;
+}
+
+bool MQTTWire::connectTimed(int fd, const struct sockaddr *addr, unsigned int addrlen, int timeoutms)
+{
+    // Non-blocking so an unreachable broker doesn't hold the thread for the SYN retries
+    int flags = fcntl(fd, F_GETFL);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+
+    bool ok = connect(fd, addr, (socklen_t) addrlen) == 0;
+    if (!ok && errno == EINPROGRESS)
+    {
+        pollfd pfd = {};
+        pfd.fd = fd;
+        pfd.events = POLLOUT;
+
+        int n;
+        do
+            n = poll(&pfd, 1, timeoutms);
+        while (n < 0 && errno == EINTR);
+
+        int error = 0;
+        socklen_t len = sizeof(error);
+        ok = n > 0 && getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error == 0;
+    }
+
+    fcntl(fd, F_SETFL, flags);
+
+    return ok;
+}
+
+bool MQTTWire::flushLocked(std::unique_lock<std::mutex> &lock)
+{
+    if (m_socket < 0)
+        return false;
+
+    if (m_ring)
+        return flushRing(lock);
+
+    // Every buffer with unsent data, oldest first
+    iovec iov[MQTT_WIRE_BUFFERS > 2 ? MQTT_WIRE_BUFFERS : 2];
+    size_t count = 0;
+    for (size_t i = m_head; count < m_buffers.size() && count < sizeof(iov) / sizeof(iov[0]); i = (i + 1) % m_buffers.size())
+    {
+        Buffer &buffer = m_buffers[i];
+        if (buffer.len == buffer.sent)
+            break;
+
+        iov[count].iov_base = buffer.data.data() + buffer.sent;
+        iov[count].iov_len = buffer.len - buffer.sent;
+        count++;
+
+        if (i == m_tail)
+            break;
+    }
+
+    if (count == 0)
+        return true;
+
+    // sendmsg is writev that doesn't raise SIGPIPE on a dead socket
+    msghdr msg = {};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+
+    ssize_t n = sendmsg(m_socket, &msg, MSG_NOSIGNAL);
+    if (n < 0)
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+    m_writes.fetch_add(1, std::memory_order_relaxed);
+    m_lastsend = std::chrono::steady_clock::now();
+
+    // Release the buffers that went out whole, the tail one is filled again
+    size_t written = (size_t) n;
+    while (written > 0)
+    {
+        Buffer &buffer = m_buffers[m_head];
+        size_t left = buffer.len - buffer.sent;
+        size_t done = written < left ? written : left;
+
+        buffer.sent += done;
+        written -= done;
+
+        if (buffer.sent < buffer.len)
+            break;
+
+        buffer.len = 0;
+        buffer.sent = 0;
+
+        if (m_head != m_tail)
+            m_head = (m_head + 1) % m_buffers.size();
+    }
+
+    return true;
+}
+
+bool MQTTWire::flushRing(std::unique_lock<std::mutex> &lock)
+{
+#ifdef MQTT_USE_IO_URING
+    // Another flush is reaping its batch, the buffers in it aren't ours to send
+    if (m_submitted)
+        return true;
+
+    // One fixed buffer write per buffer with unsent data, oldest first & linked
+    size_t order[MQTT_URING_ENTRIES];
+    io_uring_sqe *last = nullptr;
+    size_t count = 0;
+    for (size_t i = m_head; count < m_buffers.size() && count < MQTT_URING_ENTRIES; i = (i + 1) % m_buffers.size())
+    {
+        Buffer &buffer = m_buffers[i];
+        if (buffer.len == buffer.sent)
+            break;
+
+        io_uring_sqe *sqe = io_uring_get_sqe(m_ring);
+        if (sqe == nullptr)
+            break;
+
+        io_uring_prep_write_fixed(sqe, m_socket, buffer.data.data() + buffer.sent, (unsigned) (buffer.len - buffer.sent), 0, (int) i);
+        io_uring_sqe_set_data(sqe, reinterpret_cast<void *>(i));
+        sqe->flags |= IOSQE_IO_LINK;
+        last = sqe;
+        order[count++] = i;
+
+        if (i == m_tail)
+            break;
+    }
+
+    if (count == 0)
+        return true;
+
+    last->flags &= ~IOSQE_IO_LINK;
+
+    int rc = io_uring_submit(m_ring);
+    if (rc < 0)
+        return false;
+
+    m_writes.fetch_add(1, std::memory_order_relaxed);
+
+    // Reaped unlocked, publish goes on filling the tail past what was submitted
+    m_submitted = true;
+    uint64_t session = m_session;
+    lock.unlock();
+
+    // A short write cancels the writes linked after it, those buffers go again next time
+    int results[MQTT_URING_ENTRIES];
+    for (size_t i = 0; i < count; i++)
+        results[i] = -ECANCELED;
+
+    bool reaped = true;
+    for (size_t i = 0; i < count; i++)
+    {
+        io_uring_cqe *cqe;
+        if (io_uring_wait_cqe(m_ring, &cqe) < 0)
+        {
+            reaped = false;
+            break;
+        }
+
+        size_t buffer = reinterpret_cast<size_t>(io_uring_cqe_get_data(cqe));
+        for (size_t k = 0; k < count; k++)
+        {
+            if (order[k] == buffer)
+                results[k] = cqe->res;
+        }
+
+        io_uring_cqe_seen(m_ring, cqe);
+    }
+
+    lock.lock();
+    m_submitted = false;
+
+    if (!reaped)
+        return false;
+
+    // Closed meanwhile, the buffers were dropped with the connection
+    if (session != m_session)
+        return true;
+
+    for (size_t k = 0; k < count; k++)
+    {
+        int res = results[k];
+        if (res < 0)
+            return res == -EAGAIN || res == -ECANCELED || res == -EINTR;
+
+        Buffer &buffer = m_buffers[order[k]];
+        buffer.sent += (size_t) res;
+        m_lastsend = std::chrono::steady_clock::now();
+
+        if (buffer.sent < buffer.len)
+            break;
+
+        buffer.len = 0;
+        buffer.sent = 0;
+
+        if (m_head != m_tail)
+            m_head = (m_head + 1) % m_buffers.size();
+    }
+
+    return true;
+#else
+    (void) lock;
+    return false;
+#endif
+}
+
+void MQTTWire::openRing()
+{
+#ifdef MQTT_USE_IO_URING
+    m_ring = new io_uring;
+
+    if (io_uring_queue_init(MQTT_URING_ENTRIES, m_ring, 0) < 0)
+    {
+        qDebug() << "MQTT: io_uring is not available, sending with sendmsg.";
+        delete m_ring;
+        m_ring = nullptr;
+        return;
+    }
+
+    // Registered once, the kernel doesn't have to map the buffers on every write
+    std::vector<iovec> iovs(m_buffers.size());
+    for (size_t i = 0; i < m_buffers.size(); i++)
+    {
+        iovs[i].iov_base = m_buffers[i].data.data();
+        iovs[i].iov_len = m_buffers[i].data.size();
+    }
+
+    if (io_uring_register_buffers(m_ring, iovs.data(), (unsigned) iovs.size()) < 0)
+    {
+        qDebug() << "MQTT: Can't register the io_uring send buffers, sending with sendmsg.";
+        closeRing();
+    }
+#endif
+}
+
+void MQTTWire::closeRing()
+{
+#ifdef MQTT_USE_IO_URING
+    if (m_ring)
+    {
+        io_uring_queue_exit(m_ring);
+        delete m_ring;
+        m_ring = nullptr;
+    }
+#endif
+}
+
+size_t MQTTWire::encodeLength(char *out, size_t len)
+{
+    // Remaining length, 7 bits per byte, least significant first
+    size_t count = 0;
+    do
+    {
+        uint8_t byte = len & 0x7F;
+        len >>= 7;
+        out[count++] = (char) (len > 0 ? byte | 0x80 : byte);
+    }
+    while (len > 0 && count < 4);
+
+    return count;
+}
+
+#endif // MQTT_USE_EPOLL
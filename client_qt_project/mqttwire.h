@@ -0,0 +1,97 @@
+#ifndef MQTTWIRE_H
+#define MQTTWIRE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "config.h"
+
+struct MQTTMessage;
+struct io_uring;
+
+// --------------------------------------------------------
+// MQTTWire class, native MQTT 3.1.1 publish session on a plain socket
+// Replaces libmosquitto on a connection when the native publisher is on,
+// only the packets a publisher needs are handled: CONNECT/CONNACK,
+// PUBLISH QoS 1 & its PUBACK, PINGREQ/PINGRESP. A PUBLISH is assembled
+// straight from the queue slot into a ring of send buffers, there's no
+// packet object per message, and flush hands every filled buffer to the
+// kernel in one sendmsg (writev with MSG_NOSIGNAL). Partial writes are
+// picked up again by the next flush once the socket is writable.
+// Unlike libmosquitto, QoS 1 messages in flight at a disconnect are not
+// resent after the reconnect.
+// With MQTT_USE_IO_URING the send buffers are registered with an io_uring
+// and a flush submits one fixed buffer write per filled buffer, linked so
+// they complete in order. The batch is submitted under the send mutex and
+// reaped without it, so publish keeps filling the tail buffer meanwhile,
+// the written buffers are only released once their completions are in.
+// One batch is in flight at a time, a flush during it leaves the rest to
+// the next one. Without a usable io_uring in the kernel the sendmsg path
+// is used.
+// The publisher thread publishes & flushes, the network loop thread
+// reads, flushes & pings, the send side is guarded by a mutex.
+// --------------------------------------------------------
+class MQTTWire
+{
+
+public:
+    MQTTWire(size_t buffers = MQTT_WIRE_BUFFERS, size_t buffersize = MQTT_WIRE_BUFFER_SIZE);
+    ~MQTTWire();
+
+    int open(const std::string &host, int port, const std::string &clientid, int keepalive);
+    void close();
+    bool publish(const MQTTMessage &msg);
+    bool flush();
+    int read();
+    bool keepalive();
+    int getSocket() const;
+    bool wantWrite();
+    bool isFull();
+    bool usesRing() const;
+    uint64_t getPackets() const;
+    uint64_t getWrites() const;
+
+private:
+    struct Buffer
+    {
+        std::vector<char> data;
+        size_t len;  // filled
+        size_t sent; // of len, already written
+    };
+
+    MQTTWire(const MQTTWire &) = delete;
+    MQTTWire &operator=(const MQTTWire &) = delete;
+
+    bool reserve(size_t len);
+    static bool writeAll(int fd, const char *data, size_t len);
+    static bool connectTimed(int fd, const struct sockaddr *addr, unsigned int addrlen, int timeoutms);
+    bool flushLocked(std::unique_lock<std::mutex> &lock);
+    bool flushRing(std::unique_lock<std::mutex> &lock);
+    void openRing();
+    void closeRing();
+    static size_t encodeLength(char *out, size_t len);
+
+    int m_socket;
+    int m_keepalive;
+    uint16_t m_mid;
+    std::vector<Buffer> m_buffers;
+    io_uring *m_ring; // buffers registered, nullptr sends with sendmsg
+    size_t m_head;  // oldest buffer with unsent data
+    size_t m_tail;  // buffer being filled
+    bool m_submitted; // a ring batch is in flight, its flush reaps it
+    uint64_t m_session; // counts close, a batch reaped after one is dropped
+    std::mutex m_sendmutex;
+    std::vector<char> m_inbuf;
+    size_t m_inlen;
+    std::chrono::steady_clock::time_point m_lastsend;
+    std::chrono::steady_clock::time_point m_pingsent;
+    bool m_pingpending;
+    std::atomic<uint64_t> m_packets;
+    std::atomic<uint64_t> m_writes;
+
+};
+
+#endif // MQTTWIRE_H
@@ -0,0 +1,372 @@
+#include "opcuabrowser.h"
+#include <QDebug>
+#include <chrono>
+#include <opc/ua/protocol/string_utils.h>
+
+// --------------------------------------------------------
+// OPCUABrowser class below
+// --------------------------------------------------------
+OPCUABrowser::OPCUABrowser(OpcUa::UaClient *client, int workers, unsigned int nodespercall, int maxdepth) :
+    m_client(client),
+    m_services(nullptr),
+    m_workers(workers > 0 ? workers : 1),
+    m_nodespercall(nodespercall > 0 ? nodespercall : 1),
+    m_maxdepth(maxdepth),
+    m_queue(std::deque<Pending>()),
+    m_visited(std::unordered_set<std::string>()),
+    m_results(std::vector<OPCUABrowseNode>()),
+    m_active(0),
+    m_running(false),
+    m_stop(false),
+    m_browsed(0),
+    m_requests(0)
+{
+    qRegisterMetaType<std::vector<OPCUABrowseNode>>("std::vector<OPCUABrowseNode>");
+}
+
+OPCUABrowser::~OPCUABrowser()
+{
+    stop();
+    wait();
+}
+
+void OPCUABrowser::browse(const OpcUa::Node &node)
+{
+    browse(node, m_maxdepth);
+}
+
+void OPCUABrowser::browse(const OpcUa::Node &node, int maxdepth)
+{
+    // A new walk replaces the one running
+    stop();
+    wait();
+
+    Pending first;
+    first.node = browseNode(node);
+    first.maxdepth = maxdepth;
+
+    try
+    {
+        first.node.name = node.GetBrowseName().Name;
+    }
+    catch (const std::exception &exc)
+    {
+        qDebug() << "OPCUA: Browse start node has no browse name:" << exc.what();
+    }
+
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+
+        m_services = node.GetServices();
+        m_stop = false;
+        m_browsed = 0;
+        m_requests = 0;
+        m_queue.clear();
+        m_visited.clear();
+        m_results.clear();
+
+        m_visited.insert(first.node.key);
+        m_results.push_back(first.node);
+        m_queue.push_back(first);
+        m_running = true;
+    }
+
+    start();
+}
+
+void OPCUABrowser::expand(const OpcUa::Node &node)
+{
+    // Only the children are delivered, the node itself is already known
+    Pending pending;
+    pending.node = browseNode(node);
+    pending.maxdepth = 1;
+
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+
+        // Join a walk that is still running
+        if (m_running && !m_stop)
+        {
+            m_visited.insert(pending.node.key);
+            m_queue.push_back(pending);
+            m_cond.notify_all();
+            return;
+        }
+    }
+
+    // The last walk is done or ending, its queue & workers aren't touched until the thread has joined them
+    wait();
+
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+
+        m_services = node.GetServices();
+        m_stop = false;
+        m_queue.clear();
+        m_visited.insert(pending.node.key);
+        m_queue.push_back(pending);
+        m_running = true;
+    }
+
+    start();
+}
+
+void OPCUABrowser::stop()
+{
+    m_stop = true;
+
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    m_cond.notify_all();
+}
+
+void OPCUABrowser::run()
+{
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+    boost::thread_group workers;
+    for (int i = 0; i < m_workers; i++)
+        workers.create_thread(boost::bind(&OPCUABrowser::worker, this));
+
+    // Hand the results over in chunks, the UI thread adds them to the tree
+    bool done = false;
+    while (!done)
+    {
+        msleep(50);
+
+        std::vector<OPCUABrowseNode> chunk;
+        size_t pending;
+
+        {
+            boost::lock_guard<boost::mutex> lock(m_mutex);
+
+            chunk.swap(m_results);
+            pending = m_queue.size();
+            done = (m_queue.empty() && m_active == 0) || m_stop;
+
+            if (done)
+            {
+                m_queue.clear();
+                m_running = false;
+            }
+        }
+
+        if (!chunk.empty())
+            emit nodesBrowsed(chunk);
+
+        double seconds = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count() / 1000.0;
+        emit browseProgress(getBrowsed(), pending, seconds > 0.0 ? getBrowsed() / seconds : 0.0);
+    }
+
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        m_cond.notify_all();
+    }
+
+    workers.join_all();
+
+    double seconds = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count() / 1000.0;
+    qDebug() << "OPCUA: Browsed" << (unsigned long long) getBrowsed() << "nodes with" << (unsigned long long) getRequests() << "requests in" << seconds << "s";
+
+    emit browseFinished(getBrowsed(), seconds, m_stop);
+}
+
+OPCUABrowseNode OPCUABrowser::browseNode(const OpcUa::Node &node)
+{
+    OPCUABrowseNode result;
+    result.key = OpcUa::ToString(node.GetId());
+    result.id = node.GetId();
+    result.nodeclass = OpcUa::NodeClass::Unspecified;
+    result.depth = 0;
+
+    return result;
+}
+
+void OPCUABrowser::worker()
+{
+    for (;;)
+    {
+        std::vector<Pending> batch;
+
+        {
+            boost::unique_lock<boost::mutex> lock(m_mutex);
+
+            // Nothing queued yet, but a running browse or expand may still add some
+            while (m_queue.empty() && m_running && !m_stop)
+                m_cond.wait(lock);
+
+            if (m_stop || m_queue.empty())
+            {
+                m_cond.notify_all();
+                return;
+            }
+
+            while (!m_queue.empty() && batch.size() < m_nodespercall)
+            {
+                batch.push_back(m_queue.front());
+                m_queue.pop_front();
+            }
+
+            m_active++;
+        }
+
+        std::vector<Pending> found;
+
+        try
+        {
+            std::vector<OpcUa::BrowseResult> results = browseNodes(batch);
+
+            for (size_t i = 0; i < results.size() && i < batch.size(); i++)
+            {
+                for (const OpcUa::ReferenceDescription &ref : results[i].Referencies)
+                {
+                    if (!ref.IsForward)
+                        continue;
+
+                    Pending child;
+                    child.node.key = OpcUa::ToString(ref.TargetNodeId);
+                    child.node.parentkey = batch[i].node.key;
+                    child.node.id = ref.TargetNodeId;
+                    child.node.name = ref.BrowseName.Name;
+                    child.node.nodeclass = ref.TargetNodeClass;
+                    child.node.depth = batch[i].node.depth + 1;
+                    child.maxdepth = batch[i].maxdepth;
+                    found.push_back(child);
+                }
+            }
+
+            readDataTypes(found);
+        }
+        catch (const std::exception &exc)
+        {
+            qDebug() << "OPCUA: Browse of" << batch.size() << "nodes failed:" << exc.what();
+        }
+
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+
+        // A node reachable over several paths is shown & browsed only once
+        for (Pending &child : found)
+        {
+            if (!m_visited.insert(child.node.key).second)
+                continue;
+
+            if (child.node.depth < child.maxdepth)
+                m_queue.push_back(child);
+
+            m_results.push_back(child.node);
+        }
+
+        m_browsed += batch.size();
+        m_active--;
+        m_cond.notify_all();
+    }
+}
+
+std::vector<OpcUa::BrowseResult> OPCUABrowser::browseNodes(const std::vector<Pending> &nodes)
+{
+    OpcUa::NodesQuery query;
+    query.MaxReferenciesPerNode = 0;
+    for (const Pending &pending : nodes)
+        query.NodesToBrowse.push_back(describe(pending.node.id));
+
+    // The continuation points of this Browse are only valid until the next one
+    boost::lock_guard<boost::mutex> lock(m_browsemutex);
+
+    std::vector<OpcUa::BrowseResult> results = m_services->Views()->Browse(query);
+    m_requests++;
+
+    std::vector<size_t> open;
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        if (!results[i].ContinuationPoint.empty())
+            open.push_back(i);
+    }
+
+    // BrowseNext answers only for the nodes that still had a continuation point, in order.
+    // The Views API can't release them, so they are browsed to the end even when stopped.
+    while (!open.empty())
+    {
+        std::vector<OpcUa::BrowseResult> next = m_services->Views()->BrowseNext();
+        m_requests++;
+
+        if (next.empty())
+            break;
+
+        std::vector<size_t> still;
+        for (size_t i = 0; i < next.size() && i < open.size(); i++)
+        {
+            std::vector<OpcUa::ReferenceDescription> &refs = results[open[i]].Referencies;
+            refs.insert(refs.end(), next[i].Referencies.begin(), next[i].Referencies.end());
+
+            if (!next[i].ContinuationPoint.empty())
+                still.push_back(open[i]);
+        }
+
+        open.swap(still);
+    }
+
+    return results;
+}
+
+void OPCUABrowser::readDataTypes(std::vector<Pending> &nodes)
+{
+    // The data types of all variables found in one batch come with one read
+    std::vector<OpcUa::Node> variables;
+    std::vector<size_t> indexes;
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        if (nodes[i].node.nodeclass == OpcUa::NodeClass::Variable)
+        {
+            variables.push_back(OpcUa::Node(m_services, nodes[i].node.id));
+            indexes.push_back(i);
+        }
+    }
+
+    if (variables.empty())
+        return;
+
+    try
+    {
+        std::vector<OpcUa::DataValue> types = m_client->CreateServerOperations().ReadAttributes(variables, OpcUa::AttributeId::DataType);
+        m_requests++;
+
+        for (size_t i = 0; i < types.size() && i < indexes.size(); i++)
+        {
+            if ((types[i].Encoding & OpcUa::DATA_VALUE) && types[i].Value.Type() == OpcUa::VariantType::NODE_Id)
+                nodes[indexes[i]].node.datatype = types[i].Value.As<OpcUa::NodeId>();
+        }
+    }
+    catch (const std::exception &exc)
+    {
+        qDebug() << "OPCUA: Reading data types of" << variables.size() << "variables failed:" << exc.what();
+    }
+}
+
+OpcUa::BrowseDescription OPCUABrowser::describe(const OpcUa::NodeId &id)
+{
+    OpcUa::BrowseDescription desc;
+    desc.NodeToBrowse = id;
+    desc.Direction = OpcUa::BrowseDirection::Forward;
+    desc.ReferenceTypeId = OpcUa::ObjectId::HierarchicalReferences;
+    desc.IncludeSubtypes = true;
+    desc.NodeClasses = OpcUa::NodeClass::Unspecified;
+    desc.ResultMask = OpcUa::BrowseResultMask::All;
+
+    return desc;
+}
+
+uint64_t OPCUABrowser::getBrowsed() const
+{
+    return m_browsed.load(std::memory_order_relaxed);
+}
+
+uint64_t OPCUABrowser::getRequests() const
+{
+    return m_requests.load(std::memory_order_relaxed);
+}
+
+size_t OPCUABrowser::getPending()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    return m_queue.size();
+}
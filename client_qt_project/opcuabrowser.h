@@ -0,0 +1,104 @@
+#ifndef OPCUABROWSER_H
+#define OPCUABROWSER_H
+
+#include <QThread>
+#include <QMetaType>
+#include <string>
+#include <deque>
+#include <vector>
+#include <unordered_set>
+#include <atomic>
+#include <boost/thread.hpp>
+#include <opc/ua/client/client.h>
+#include <opc/ua/node.h>
+
+// --------------------------------------------------------
+// One browsed node, parentkey is empty for the start node
+// datatype is only set for variables
+// --------------------------------------------------------
+struct OPCUABrowseNode
+{
+    std::string key;
+    std::string parentkey;
+    OpcUa::NodeId id;
+    std::string name;
+    OpcUa::NodeClass nodeclass;
+    OpcUa::NodeId datatype;
+    int depth;
+};
+
+Q_DECLARE_METATYPE(std::vector<OPCUABrowseNode>)
+
+// --------------------------------------------------------
+// OPCUABrowser class, walks the address space off the UI thread
+// Worker threads take up to nodespercall nodes from a shared queue and
+// browse them with one Browse request each. FreeOpcUa keeps the
+// continuation points of the last Browse in the session without locking,
+// so a Browse & the BrowseNext calls that finish it run under one
+// exclusive lock, the parallelism comes from the nodes per call & the
+// workers reading data types meanwhile. Continuation points are always
+// browsed to the end, even when stopped, so the server frees them.
+// Results are streamed to the UI in chunks with nodesBrowsed, parents
+// always before their children. Every node is browsed once per walk.
+// The data types of the variables in a batch are read with one request.
+// expand() browses just the children of one node, for the lazy tree, and
+// joins a walk that is still running. A walk that is ending is left alone,
+// expand waits for its thread & starts a new one.
+// --------------------------------------------------------
+class OPCUABrowser : public QThread
+{
+    Q_OBJECT
+
+public:
+    OPCUABrowser(OpcUa::UaClient *client = nullptr, int workers = 4, unsigned int nodespercall = 50, int maxdepth = 64);
+    ~OPCUABrowser();
+
+    void browse(const OpcUa::Node &node);
+    void browse(const OpcUa::Node &node, int maxdepth);
+    void expand(const OpcUa::Node &node);
+    void stop();
+    uint64_t getBrowsed() const;
+    uint64_t getRequests() const;
+    size_t getPending();
+
+signals:
+    void nodesBrowsed(const std::vector<OPCUABrowseNode> &nodes);
+    void browseProgress(quint64 nodes, quint64 pending, double rate);
+    void browseFinished(quint64 nodes, double seconds, bool stopped);
+
+private:
+    struct Pending
+    {
+        OPCUABrowseNode node;
+        int maxdepth;
+    };
+
+    static OPCUABrowseNode browseNode(const OpcUa::Node &node);
+    void worker();
+    std::vector<OpcUa::BrowseResult> browseNodes(const std::vector<Pending> &nodes);
+    void readDataTypes(std::vector<Pending> &nodes);
+    static OpcUa::BrowseDescription describe(const OpcUa::NodeId &id);
+
+    OpcUa::UaClient *m_client;
+    OpcUa::Services::SharedPtr m_services;
+    int m_workers;
+    unsigned int m_nodespercall;
+    int m_maxdepth;
+    std::deque<Pending> m_queue;
+    std::unordered_set<std::string> m_visited;
+    std::vector<OPCUABrowseNode> m_results;
+    int m_active;
+    bool m_running; // A walk is in progress, expand() joins it
+    boost::mutex m_mutex;
+    boost::condition_variable m_cond;
+    boost::mutex m_browsemutex; // Browse + BrowseNext, continuation points live in the session
+    std::atomic<bool> m_stop;
+    std::atomic<uint64_t> m_browsed;
+    std::atomic<uint64_t> m_requests;
+
+protected:
+    void run() override;
+
+};
+
+#endif // OPCUABROWSER_H
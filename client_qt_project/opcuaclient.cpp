@@ -1,28 +1,218 @@
 #include "opcuaclient.h"
-#include "mainwindow.h"
 #include "mqttclient.h"
-#include "coupleritem.h"
+#include "mqttbatcher.h"
+#include "config.h"
+#include "opcuavalueencoder.h"
 #include <QDebug>
 #include <boost/thread.hpp>
+#include <opc/ua/protocol/string_utils.h>
 
 // --------------------------------------------------------
 // Callback client class below
 // --------------------------------------------------------
-OPCUASubClient::OPCUASubClient(MQTTClient *cli) : m_mqttclient(cli)
+OPCUASubClient::OPCUASubClient(MQTTClient *cli) :
+    m_mqttclient(cli),
+    m_topic(cli ? cli->getTopic() : "opcuamqtt"),
+    m_links(std::vector<OPCUALinkInfo>()),
+    m_lasthandle(0),
+    m_freehandles(std::deque<uint32_t>()),
+    m_payloadmode(PAYLOAD_VALUE),
+    m_encodefailures(0),
+    m_latencycount(0),
+    m_latencysum(0),
+    m_latencymax(0)
 {
 
 }
 
-void OPCUASubClient::DataChange(uint32_t handle, const OpcUa::Node& node, const OpcUa::Variant& val, OpcUa::AttributeId attr)
+uint32_t OPCUASubClient::newHandle()
 {
-    //qDebug() << "OPCUA: DataChange event, value of Node " << node.ToString().c_str() << " is now: "  << val.ToString().c_str();
+    boost::unique_lock<boost::shared_mutex> lock(m_linksmutex);
 
-    if (m_mqttclient->getStatus() == CONNECTED)
+    // Shared by the subscriptions and the poller, 0 is never handed out. The
+    // longest free handle is reused first, late notifications for it are long gone
+    if (!m_freehandles.empty())
     {
-        std::string strval = val.ToString();
+        uint32_t handle = m_freehandles.front();
+        m_freehandles.pop_front();
+        return handle;
+    }
+
+    return ++m_lasthandle;
+}
+
+void OPCUASubClient::registerLinks(const std::vector<uint32_t> &handles, const std::vector<OpcUa::Node> &nodes, const std::vector<OpcUa::DataValue> &names, const OPCUALinkOptions &options)
+{
+    boost::unique_lock<boost::shared_mutex> lock(m_linksmutex);
+
+    for (size_t i = 0; i < handles.size(); i++)
+    {
+        if (handles[i] >= m_links.size())
+            m_links.resize(handles[i] + 1);
+
+        OPCUALinkInfo &link = m_links[handles[i]];
+        link.active = true;
+        link.coalesce = options.coalesce;
+        link.ns = nodes[i].GetId().GetNamespaceIndex();
+        link.name = linkName(nodes[i], i < names.size() ? names[i] : OpcUa::DataValue());
+        buildTopics(link);
+    }
+}
+
+void OPCUASubClient::unregisterLink(uint32_t handle)
+{
+    boost::unique_lock<boost::shared_mutex> lock(m_linksmutex);
+
+    if (handle < m_links.size() && m_links[handle].active)
+    {
+        m_links[handle] = OPCUALinkInfo();
+        m_freehandles.push_back(handle);
+    }
+}
+
+void OPCUASubClient::clearLinks()
+{
+    boost::unique_lock<boost::shared_mutex> lock(m_linksmutex);
+
+    // Called once the poller & the subscriptions have dropped every handle
+    m_links.clear();
+    m_freehandles.clear();
+    m_lasthandle = 0;
+}
+
+void OPCUASubClient::setTopic(const std::string &topic)
+{
+    boost::unique_lock<boost::shared_mutex> lock(m_linksmutex);
+
+    m_topic = topic;
+
+    for (OPCUALinkInfo &link : m_links)
+    {
+        if (link.active)
+            buildTopics(link);
+    }
+}
+
+void OPCUASubClient::setPayloadMode(const PAYLOAD_MODE mode)
+{
+    m_payloadmode = mode;
+}
+
+void OPCUASubClient::dataValueChange(uint32_t handle, const OpcUa::DataValue &val)
+{
+    // End-to-end latency, source timestamp -> here
+    if (val.SourceTimestamp.Value != 0)
+    {
+        int64_t latency = (OpcUa::DateTime::Current().Value - val.SourceTimestamp.Value) / 10;
+
+        if (latency >= 0)
+        {
+            m_latencycount.fetch_add(1, std::memory_order_relaxed);
+            m_latencysum.fetch_add((uint64_t) latency, std::memory_order_relaxed);
 
-        m_mqttclient->publish_message(std::to_string(node.GetId().GetNamespaceIndex()) + "/" + node.GetBrowseName().Name, strval.size(), (const void *) strval.c_str());
+            uint64_t max = m_latencymax.load(std::memory_order_relaxed);
+            while ((uint64_t) latency > max && !m_latencymax.compare_exchange_weak(max, (uint64_t) latency, std::memory_order_relaxed));
+        }
     }
+
+    boost::shared_lock<boost::shared_mutex> lock(m_linksmutex);
+
+    if (handle >= m_links.size() || !m_links[handle].active)
+        return;
+
+    // Values inside a frame must be valid JSON, so strings get quoted
+    MQTTBatcher *batcher = m_mqttclient->getBatcher();
+    bool batched = batcher->isEnabled();
+
+    // Reusable per-thread buffer, no allocation per message
+    static thread_local char payload[MQTT_MSG_PAYLOAD_MAX];
+    int len = m_payloadmode == PAYLOAD_JSON ?
+                OPCUAValueEncoder::encodeDataValue(val, payload, sizeof(payload)) :
+                OPCUAValueEncoder::encode(val.Value, payload, sizeof(payload), batched);
+
+    if (len < 0)
+    {
+        m_encodefailures.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    const OPCUALinkInfo &link = m_links[handle];
+
+    // A value too large for a frame goes out on its own topic
+    if (batched && batcher->add(link.group, handle, link.key, payload, (size_t) len))
+        return;
+
+    m_mqttclient->publish_topic(link.topic, len, (const void *) payload, !link.coalesce);
+}
+
+void OPCUASubClient::dataChangesDone()
+{
+    // Without a time window every PublishResult becomes one frame per group
+    MQTTBatcher *batcher = m_mqttclient->getBatcher();
+
+    if (batcher->isEnabled() && batcher->getWindow() == 0)
+        batcher->flush();
+}
+
+PAYLOAD_MODE OPCUASubClient::getPayloadMode() const
+{
+    return m_payloadmode;
+}
+
+uint64_t OPCUASubClient::getEncodeFailures() const
+{
+    return m_encodefailures.load(std::memory_order_relaxed);
+}
+
+uint64_t OPCUASubClient::getLatencyCount() const
+{
+    return m_latencycount.load(std::memory_order_relaxed);
+}
+
+double OPCUASubClient::getLatencyAvg() const
+{
+    uint64_t count = getLatencyCount();
+
+    return count > 0 ? m_latencysum.load(std::memory_order_relaxed) / (double) count / 1000.0 : 0.0;
+}
+
+double OPCUASubClient::getLatencyMax() const
+{
+    return m_latencymax.load(std::memory_order_relaxed) / 1000.0;
+}
+
+void OPCUASubClient::resetLatency()
+{
+    m_latencycount = 0;
+    m_latencysum = 0;
+    m_latencymax = 0;
+}
+
+void OPCUASubClient::buildTopics(OPCUALinkInfo &link)
+{
+    link.group = m_topic + "/" + std::to_string(link.ns);
+    link.topic = link.group + "/" + link.name;
+
+    // Worst case every character is escaped as \uXXXX
+    std::vector<char> key(link.name.size() * 6 + 2);
+    int len = OPCUAValueEncoder::encode(OpcUa::Variant(link.name), key.data(), key.size(), true);
+    link.key = std::string(key.data(), len > 0 ? (size_t) len : 0);
+}
+
+std::string OPCUASubClient::linkName(const OpcUa::Node &node, const OpcUa::DataValue &name)
+{
+    if (name.Status == OpcUa::StatusCode::Good && name.Value.Type() == OpcUa::VariantType::QUALIFIED_NAME)
+        return name.Value.As<OpcUa::QualifiedName>().Name;
+
+    // No browse name, fall back to the node identifier
+    OpcUa::NodeId id = node.GetId();
+
+    if (id.IsInteger())
+        return std::to_string(id.GetIntegerIdentifier());
+    else if (id.IsString())
+        return id.GetStringIdentifier();
+
+    return node.ToString();
 }
 
 // --------------------------------------------------------
@@ -35,7 +225,9 @@ OPCUAClient::OPCUAClient(MQTTClient *cl, std::string ep) :
     m_targetEndpoint(OpcUa::EndpointDescription()),
     m_client(new OpcUa::UaClient(false)),
     m_subclient(new OPCUASubClient(m_mqttclient)),
-    m_subs(std::map<std::string, std::unique_ptr<OpcUa::Subscription>>()),
+    m_registry(new OPCUANodeRegistry(m_client, OPCUA_MAX_ITEMS_PER_CALL)),
+    m_subpool(new OPCUASubPool(m_client, m_subclient, m_registry, OPCUA_SUB_MAX_ITEMS, OPCUA_MAX_ITEMS_PER_CALL)),
+    m_poller(new OPCUAPoller(m_client, m_subclient, m_registry, OPCUA_POLL_GROUP_SIZE)),
     m_root(nullptr),
     m_objects(nullptr),
     m_runstate(NOTSTARTED),
@@ -52,6 +244,15 @@ OPCUAClient::~OPCUAClient()
     if (m_root)
         delete m_root;
 
+    if (m_poller)
+        delete m_poller;
+
+    if (m_subpool)
+        delete m_subpool;
+
+    if (m_registry)
+        delete m_registry;
+
     if (m_subclient)
         delete m_subclient;
 
@@ -69,30 +270,64 @@ OPCUAClient::~OPCUAClient()
     }
 }
 
-// TODO: Handle subscriptions in some better way...
-void OPCUAClient::createOpcUaMqttLink(CouplerItem *item, int period)
+uint32_t OPCUAClient::createOpcUaMqttLink(const OpcUa::Node &node, const OPCUALinkOptions &options)
+{
+    if (options.poll)
+    {
+        OPCUALinkResult result = m_poller->add(std::vector<OpcUa::Node>(1, node), options).front();
+
+        if (result.status != OpcUa::StatusCode::Good)
+            throw std::runtime_error("OPCUA: Failed to poll " + node.ToString() + " (" + OpcUa::ToString(result.status) + ")");
+
+        return result.handle;
+    }
+
+    return m_subpool->subscribe(node, options);
+}
+
+std::vector<OPCUALinkResult> OPCUAClient::createOpcUaMqttLinks(const std::vector<OpcUa::Node> &nodes, const OPCUALinkOptions &options)
 {
-    OpcUa::Node node = item->getOpcUaNode();
-    std::string key = node.ToString();
+    if (options.poll)
+        return m_poller->add(nodes, options);
+
+    return m_subpool->subscribe(nodes, options);
+}
 
-    if (getSubs().find(key) == getSubs().end() || item->getSubHandle() == 0)
+bool OPCUAClient::removeOpcUaMqttLink(const OpcUa::Node &node)
+{
+    if (m_subpool->isSubscribed(node))
+    {
+        m_subpool->unsubscribe(node);
+        return true;
+    }
+    else if (m_poller->isPolled(node))
     {
-        getSubs()[key] = m_client->CreateSubscription((unsigned int) period, *m_subclient);
-        uint32_t handle = getSubs().at(key).get()->SubscribeDataChange(node);
-        item->setSubHandle(handle);
+        m_poller->remove(node);
+        return true;
     }
+
+    return false;
 }
 
-void OPCUAClient::removeOpcUaMqttLink(CouplerItem *item)
+std::vector<OpcUa::DataValue> OPCUAClient::readValues(const std::vector<OpcUa::Node> &nodes)
 {
-    std::string key = item->getOpcUaNode().ToString();
+    // One ReadAttributes per chunk instead of a GetValue per node, registered ids where known
+    std::vector<OpcUa::DataValue> values;
+    values.reserve(nodes.size());
 
-    if (getSubs().find(key) != getSubs().end())
+    size_t maxpercall = m_subpool->getMaxItemsPerCall();
+    for (size_t first = 0; first < nodes.size(); first += maxpercall)
     {
-        OpcUa::Subscription *sub = getSubs().at(key).get();
-        sub->UnSubscribe(item->getSubHandle());
-        item->setSubHandle(0);
+        std::vector<OpcUa::Node> chunk;
+        for (size_t i = first; i < nodes.size() && i < first + maxpercall; i++)
+            chunk.push_back(m_registry->resolve(nodes[i]));
+
+        std::vector<OpcUa::DataValue> read = m_client->CreateServerOperations().ReadAttributes(chunk, OpcUa::AttributeId::Value);
+        read.resize(chunk.size());
+        values.insert(values.end(), read.begin(), read.end());
     }
+
+    return values;
 }
 
 void OPCUAClient::requestEndpoints()
@@ -132,16 +367,25 @@ void OPCUAClient::run()
     if (m_objects)
         delete m_objects;
 
-    // Delete old subscriptions
-    if (!m_subs.empty())
-        m_subs.clear();
+    // Delete old subscriptions & poll groups
+    m_poller->clear();
+    m_subpool->clear();
 
     m_runstate = RUNNING;
 
     try
     {
-        qDebug() << "OPCUA: Connecting to" << m_targetEndpoint.EndpointUrl.c_str() << "...";
-        m_client->Connect(m_targetEndpoint);
+        // Without a target endpoint one without security is picked at the init address
+        if (m_targetEndpoint.EndpointUrl.empty())
+        {
+            qDebug() << "OPCUA: Connecting to" << m_initEndpoint.c_str() << "...";
+            m_client->Connect(m_initEndpoint);
+        }
+        else
+        {
+            qDebug() << "OPCUA: Connecting to" << m_targetEndpoint.EndpointUrl.c_str() << "...";
+            m_client->Connect(m_targetEndpoint);
+        }
         qDebug() << "OPCUA: Security policy: " << m_client->GetSecurityPolicy().c_str();
         m_status = CONNECTED;
 
@@ -151,6 +395,12 @@ void OPCUAClient::run()
         qDebug() << "OPCUA: Requested root node is" << m_root->ToString().c_str();
         qDebug() << "OPCUA: Requested objects node is" << m_objects->ToString().c_str();
 
+        readOperationLimits();
+
+        // Nodes written in an earlier session get their registered ids back
+        m_registry->reregister();
+        m_poller->start();
+
         // The test below works, but emits errors. QT Doesn't like other threads
         // accessing the main UI thread widgets.
         // -------------------------------------
@@ -166,8 +416,13 @@ void OPCUAClient::run()
             msleep(100); // Do something, currently nothing.
         }
 
-        qDebug() << "OPCUA: Disconnecting from server...";
+        qDebug() << "OPCUA: Disconnecting from server, value latency avg" << m_subclient->getLatencyAvg()
+                 << "ms max" << m_subclient->getLatencyMax() << "ms over" << (unsigned long long) m_subclient->getLatencyCount() << "values";
+        stopPoller();
+        m_registry->disconnect();
         m_client->Disconnect();
+        m_poller->clear();
+        m_subpool->clear();
         m_status = DISCONNECTED;
     }
     catch (const std::exception &exc)
@@ -183,9 +438,51 @@ void OPCUAClient::run()
         m_runstate = STOPPED;
     }
 
+    stopPoller();
+    m_registry->disconnect();
     m_runstate = FINISHED;
 }
 
+void OPCUAClient::readOperationLimits()
+{
+    // Server_ServerCapabilities_OperationLimits_MaxMonitoredItemsPerCall, missing from ObjectId
+    const OpcUa::NodeId maxMonitoredItemsPerCall = OpcUa::NumericNodeId(11714);
+    unsigned int maxpercall = OPCUA_MAX_ITEMS_PER_CALL;
+
+    try
+    {
+        OpcUa::Variant value = m_client->GetNode(maxMonitoredItemsPerCall).GetValue();
+
+        // 0 means no limit, keep our own chunk size then
+        if (value.Type() == OpcUa::VariantType::UINT32 && value.As<uint32_t>() > 0)
+            maxpercall = value.As<uint32_t>();
+    }
+    catch (const std::exception &exc)
+    {
+        qDebug() << "OPCUA: MaxMonitoredItemsPerCall not available:" << exc.what();
+    }
+
+    qDebug() << "OPCUA: Creating monitored items in chunks of" << maxpercall;
+    m_subpool->setMaxItemsPerCall(maxpercall);
+}
+
+void OPCUAClient::stopPoller()
+{
+    if (m_poller->getRunState() != RUNNING)
+        return;
+
+    m_poller->setRunState(STOPPED);
+    m_poller->wait();
+
+    // Poll timing per group, to tune the group size against the server
+    for (const OPCUAPollStats &stats : m_poller->getStats())
+    {
+        qDebug() << "OPCUA: Poll group" << stats.period << "ms" << (unsigned long long) stats.items << "items, polls" << (unsigned long long) stats.polls
+                 << "changes" << (unsigned long long) stats.changes << "errors" << (unsigned long long) stats.errors << "overruns" << (unsigned long long) stats.overruns
+                 << "read avg" << stats.readavg << "ms max" << stats.readmax << "ms";
+    }
+}
+
 void OPCUAClient::setInitEndpoint(std::string endpoint)
 {
     m_initEndpoint = endpoint;
@@ -206,6 +503,11 @@ void OPCUAClient::setStatus(const CLIENT_STATUS status)
     m_status = status;
 }
 
+void OPCUAClient::setMaxItemsPerSub(unsigned int maxitems)
+{
+    m_subpool->setMaxItemsPerSub(maxitems);
+}
+
 std::string OPCUAClient::getInitEndpoint() const
 {
     return m_initEndpoint;
@@ -231,11 +533,19 @@ OPCUASubClient *OPCUAClient::getSubClient() const
     return m_subclient;
 }
 
-boost::mutex mutex;
-std::map<std::string, std::unique_ptr<OpcUa::Subscription>> &OPCUAClient::getSubs()
+OPCUASubPool *OPCUAClient::getSubPool() const
+{
+    return m_subpool;
+}
+
+OPCUAPoller *OPCUAClient::getPoller() const
+{
+    return m_poller;
+}
+
+OPCUANodeRegistry *OPCUAClient::getRegistry() const
 {
-    boost::lock_guard<boost::mutex> lock(mutex);
-    return m_subs;
+    return m_registry;
 }
 
 OpcUa::Node *OPCUAClient::getRootNode() const
@@ -4,16 +4,51 @@
 #include <QThread>
 #include <string>
 #include <map>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <boost/thread.hpp>
 #include <opc/ua/client/client.h>
 #include <opc/ua/node.h>
 #include <opc/ua/subscription.h>
 #include "clientstates.h"
+#include "opcuasubpool.h"
+#include "opcuapoller.h"
+#include "opcuanoderegistry.h"
 
 class MQTTClient;
-class CouplerItem;
+
+// --------------------------------------------------------
+// Payload published per value change
+// PAYLOAD_VALUE: the value only
+// PAYLOAD_JSON: value, quality, status code & source timestamp
+// --------------------------------------------------------
+enum PAYLOAD_MODE
+{
+    PAYLOAD_VALUE = 0, PAYLOAD_JSON = 1
+};
+
+// --------------------------------------------------------
+// Link metadata, resolved once at link time
+// Batched changes go to the group topic, under the quoted key.
+// --------------------------------------------------------
+struct OPCUALinkInfo
+{
+    bool active;
+    bool coalesce;
+    uint16_t ns;
+    std::string name;
+    std::string topic;
+    std::string group;
+    std::string key;
+};
 
 // --------------------------------------------------------
 // Callback client class below
+// Links are kept in a table indexed by client handle, so the
+// notification path never has to ask the server anything. Handles of
+// unlinked nodes are handed out again, oldest first, and clearLinks starts
+// over from 1, so the table stays as large as the most links at one time.
 // --------------------------------------------------------
 class OPCUASubClient : public OpcUa::SubscriptionHandler
 {
@@ -21,10 +56,36 @@ class OPCUASubClient : public OpcUa::SubscriptionHandler
 public:
     OPCUASubClient(MQTTClient *cl = nullptr);
 
+    uint32_t newHandle();
+    void registerLinks(const std::vector<uint32_t> &handles, const std::vector<OpcUa::Node> &nodes, const std::vector<OpcUa::DataValue> &names, const OPCUALinkOptions &options);
+    void unregisterLink(uint32_t handle);
+    void clearLinks();
+    void setTopic(const std::string &topic);
+    void setPayloadMode(const PAYLOAD_MODE mode);
+    void dataValueChange(uint32_t handle, const OpcUa::DataValue &val);
+    void dataChangesDone();
+    PAYLOAD_MODE getPayloadMode() const;
+    uint64_t getEncodeFailures() const;
+    uint64_t getLatencyCount() const;
+    double getLatencyAvg() const;
+    double getLatencyMax() const;
+    void resetLatency();
+
 private:
-    virtual void DataChange(uint32_t handle, const OpcUa::Node& node, const OpcUa::Variant& val, OpcUa::AttributeId attr) override;
+    void buildTopics(OPCUALinkInfo &link);
+    static std::string linkName(const OpcUa::Node &node, const OpcUa::DataValue &name);
 
     MQTTClient *m_mqttclient;
+    std::string m_topic;
+    std::vector<OPCUALinkInfo> m_links;
+    uint32_t m_lasthandle;
+    std::deque<uint32_t> m_freehandles;
+    boost::shared_mutex m_linksmutex;
+    volatile PAYLOAD_MODE m_payloadmode;
+    std::atomic<uint64_t> m_encodefailures;
+    std::atomic<uint64_t> m_latencycount;
+    std::atomic<uint64_t> m_latencysum; // microseconds
+    std::atomic<uint64_t> m_latencymax; // microseconds
 
 };
 
@@ -39,19 +100,24 @@ public:
     OPCUAClient(MQTTClient *cl = nullptr, std::string ep = "opc.tcp://localhost:4841/");
     ~OPCUAClient();
 
-    void createOpcUaMqttLink(CouplerItem *item, int period);
-    void removeOpcUaMqttLink(CouplerItem *item);
+    uint32_t createOpcUaMqttLink(const OpcUa::Node &node, const OPCUALinkOptions &options = OPCUALinkOptions());
+    std::vector<OPCUALinkResult> createOpcUaMqttLinks(const std::vector<OpcUa::Node> &nodes, const OPCUALinkOptions &options = OPCUALinkOptions());
+    bool removeOpcUaMqttLink(const OpcUa::Node &node);
+    std::vector<OpcUa::DataValue> readValues(const std::vector<OpcUa::Node> &nodes);
     void requestEndpoints();
     void setInitEndpoint(std::string endpoint);
     void setTargetEndpoint(OpcUa::EndpointDescription endpoint);
     void setRunState(const CLIENT_STATE state);
     void setStatus(const CLIENT_STATUS status);
+    void setMaxItemsPerSub(unsigned int maxitems);
     std::string getInitEndpoint() const;
     std::vector<OpcUa::EndpointDescription> getEndpoints() const;
     OpcUa::EndpointDescription getTargetEndpoint() const;
     OpcUa::UaClient *getClient() const;
     OPCUASubClient *getSubClient() const;
-    std::map<std::string, std::unique_ptr<OpcUa::Subscription>> &getSubs();
+    OPCUASubPool *getSubPool() const;
+    OPCUAPoller *getPoller() const;
+    OPCUANodeRegistry *getRegistry() const;
     OpcUa::Node *getRootNode() const;
     OpcUa::Node *getObjectsNode() const;
     CLIENT_STATE getRunState() const;
@@ -59,13 +125,18 @@ public:
     static std::string securityLevelToString(int level);
 
 private:
+    void readOperationLimits();
+    void stopPoller();
+
     MQTTClient *m_mqttclient;
     std::string m_initEndpoint;
     std::vector<OpcUa::EndpointDescription> m_endpoints;
     OpcUa::EndpointDescription m_targetEndpoint;
     OpcUa::UaClient *m_client;
     OPCUASubClient *m_subclient;
-    std::map<std::string, std::unique_ptr<OpcUa::Subscription>> m_subs;
+    OPCUANodeRegistry *m_registry;
+    OPCUASubPool *m_subpool;
+    OPCUAPoller *m_poller;
     OpcUa::Node *m_root;
     OpcUa::Node *m_objects;
     volatile CLIENT_STATE m_runstate;
@@ -0,0 +1,156 @@
+#include "opcualinkmatcher.h"
+#include <QDebug>
+#include <opc/ua/protocol/string_utils.h>
+
+// --------------------------------------------------------
+// Link rule matcher class below
+// --------------------------------------------------------
+OPCUALinkMatcher::OPCUALinkMatcher() :
+    m_rules(std::vector<OPCUALinkRule>()),
+    m_patterns(std::vector<QRegularExpression>()),
+    m_entries(std::vector<Entry>()),
+    m_paths(std::unordered_map<std::string, std::string>()),
+    m_matched(std::unordered_set<std::string>())
+{
+
+}
+
+void OPCUALinkMatcher::clear()
+{
+    m_entries.clear();
+    m_paths.clear();
+    m_matched.clear();
+}
+
+std::vector<OPCUALinkSet> OPCUALinkMatcher::setRules(const std::vector<OPCUALinkRule> &rules)
+{
+    m_rules = rules;
+    m_patterns.clear();
+
+    for (const OPCUALinkRule &rule : m_rules)
+        m_patterns.push_back(compile(rule));
+
+    // Nodes matched by an earlier rule set stay handed out
+    return match(0);
+}
+
+std::vector<OPCUALinkSet> OPCUALinkMatcher::add(const std::vector<OPCUABrowseNode> &nodes)
+{
+    size_t first = m_entries.size();
+
+    // Parents come before their children, the path is the parent's path & the name
+    for (const OPCUABrowseNode &node : nodes)
+    {
+        auto parent = m_paths.find(node.parentkey);
+        std::string path = parent != m_paths.end() ? parent->second + "/" + node.name : node.name;
+
+        if (!m_paths.insert(std::make_pair(node.key, path)).second)
+            continue;
+
+        if (node.nodeclass != OpcUa::NodeClass::Variable)
+            continue;
+
+        Entry entry;
+        entry.id = node.id;
+        entry.key = node.key;
+        entry.path = path;
+        entry.name = node.name;
+        entry.datatype = OpcUa::ToString(node.datatype);
+        m_entries.push_back(entry);
+    }
+
+    return match(first);
+}
+
+const std::vector<OPCUALinkRule> &OPCUALinkMatcher::getRules() const
+{
+    return m_rules;
+}
+
+size_t OPCUALinkMatcher::getIndexed() const
+{
+    return m_paths.size();
+}
+
+std::vector<OPCUALinkSet> OPCUALinkMatcher::match(size_t first)
+{
+    std::vector<OPCUALinkSet> sets(m_rules.size());
+    for (size_t r = 0; r < m_rules.size(); r++)
+        sets[r].options = m_rules[r].options;
+
+    if (m_rules.empty())
+        return std::vector<OPCUALinkSet>();
+
+    for (size_t i = first; i < m_entries.size(); i++)
+    {
+        const Entry &entry = m_entries[i];
+        if (m_matched.count(entry.key))
+            continue;
+
+        for (size_t r = 0; r < m_rules.size(); r++)
+        {
+            if (!matches(r, entry))
+                continue;
+
+            sets[r].nodes.push_back(entry.id);
+            m_matched.insert(entry.key);
+            break;
+        }
+    }
+
+    // Only the rules that matched something
+    std::vector<OPCUALinkSet> found;
+    for (OPCUALinkSet &set : sets)
+    {
+        if (!set.nodes.empty())
+            found.push_back(std::move(set));
+    }
+
+    return found;
+}
+
+bool OPCUALinkMatcher::matches(size_t rule, const Entry &entry) const
+{
+    const OPCUALinkRule &r = m_rules[rule];
+
+    // Cheapest tests first, the pattern is only run on what's left
+    if (r.ns >= 0 && static_cast<int>(entry.id.GetNamespaceIndex()) != r.ns)
+        return false;
+
+    if (!r.datatype.empty() && entry.datatype != r.datatype)
+        return false;
+
+    // The prefix has to end at a path separator, "A/B" doesn't match "A/BC"
+    if (!r.path.empty())
+    {
+        if (entry.path.compare(0, r.path.size(), r.path) != 0)
+            return false;
+
+        if (entry.path.size() > r.path.size() && entry.path[r.path.size()] != '/')
+            return false;
+    }
+
+    return m_patterns[rule].match(QString::fromStdString(entry.name)).hasMatch();
+}
+
+QRegularExpression OPCUALinkMatcher::compile(const OPCUALinkRule &rule)
+{
+    QString pattern = QString::fromStdString(rule.pattern);
+
+    // Glob, * & ? over the whole name
+    if (!rule.regex)
+    {
+        pattern = QRegularExpression::escape(pattern);
+        pattern.replace("\\*", ".*");
+        pattern.replace("\\?", ".");
+        pattern = "^" + pattern + "$";
+    }
+
+    QRegularExpression regex(pattern);
+    regex.optimize();
+
+    if (!regex.isValid())
+        qDebug() << "OPCUA: Invalid link rule pattern" << QString::fromStdString(rule.pattern) << regex.errorString();
+
+    return regex;
+}
@@ -0,0 +1,54 @@
+#ifndef OPCUALINKMATCHER_H
+#define OPCUALINKMATCHER_H
+
+#include <QRegularExpression>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include "opcuabrowser.h"
+#include "opcualinkstore.h"
+
+// --------------------------------------------------------
+// OPCUALinkMatcher class, resolves link rules against browsed nodes
+// Every browsed node is indexed once with its browse path, Variables are
+// kept for matching. New nodes are only matched against the rules when they
+// are added, and a node is handed out once, to the first rule it matches.
+// Setting the rules matches the whole index again. The result is one link
+// set per rule, ready for OPCUAClient::createOpcUaMqttLinks.
+// --------------------------------------------------------
+class OPCUALinkMatcher
+{
+
+public:
+    OPCUALinkMatcher();
+
+    void clear();
+    std::vector<OPCUALinkSet> setRules(const std::vector<OPCUALinkRule> &rules);
+    std::vector<OPCUALinkSet> add(const std::vector<OPCUABrowseNode> &nodes);
+    const std::vector<OPCUALinkRule> &getRules() const;
+    size_t getIndexed() const;
+
+private:
+    struct Entry
+    {
+        OpcUa::NodeId id;
+        std::string key;
+        std::string path;
+        std::string name;
+        std::string datatype;
+    };
+
+    std::vector<OPCUALinkSet> match(size_t first);
+    bool matches(size_t rule, const Entry &entry) const;
+    static QRegularExpression compile(const OPCUALinkRule &rule);
+
+    std::vector<OPCUALinkRule> m_rules;
+    std::vector<QRegularExpression> m_patterns;
+    std::vector<Entry> m_entries;
+    std::unordered_map<std::string, std::string> m_paths;
+    std::unordered_set<std::string> m_matched;
+
+};
+
+#endif // OPCUALINKMATCHER_H
@@ -0,0 +1,200 @@
+#include "opcualinkstore.h"
+#include <QDebug>
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+#include <opc/ua/protocol/string_utils.h>
+
+// --------------------------------------------------------
+// Link set store class below
+// --------------------------------------------------------
+std::vector<OPCUALinkSet> OPCUALinkStore::load(QSettings &settings)
+{
+    std::vector<OPCUALinkSet> sets;
+
+    int count = settings.beginReadArray("Links");
+    for (int i = 0; i < count; i++)
+    {
+        settings.setArrayIndex(i);
+
+        // NodeIds hold ';', so the Nodes list has to be quoted in the INI file
+        OPCUALinkSet set;
+        for (const QString &node : settings.value("Nodes").toStringList())
+        {
+            if (node.trimmed().isEmpty())
+                continue;
+
+            try
+            {
+                set.nodes.push_back(OpcUa::ToNodeId(node.trimmed().toStdString()));
+            }
+            catch (const std::exception &e)
+            {
+                qDebug() << "OPCUA: Invalid NodeId" << node << "in link set" << i + 1 << e.what();
+            }
+        }
+
+        QString nodefile = settings.value("NodeFile").toString();
+        if (!nodefile.isEmpty())
+        {
+            std::vector<OpcUa::NodeId> nodes = readNodeFile(nodefile);
+            set.nodes.insert(set.nodes.end(), nodes.begin(), nodes.end());
+        }
+
+        set.options = readOptions(settings);
+
+        sets.push_back(set);
+    }
+    settings.endArray();
+
+    return sets;
+}
+
+void OPCUALinkStore::save(QSettings &settings, const std::vector<OPCUALinkSet> &sets)
+{
+    settings.remove("Links");
+
+    settings.beginWriteArray("Links", static_cast<int>(sets.size()));
+    for (size_t i = 0; i < sets.size(); i++)
+    {
+        const OPCUALinkSet &set = sets[i];
+        settings.setArrayIndex(static_cast<int>(i));
+
+        QStringList nodes;
+        for (const OpcUa::NodeId &id : set.nodes)
+            nodes.append(QString::fromStdString(OpcUa::ToString(id)));
+
+        settings.setValue("Nodes", nodes);
+        writeOptions(settings, set.options);
+    }
+    settings.endArray();
+}
+
+std::vector<OPCUALinkRule> OPCUALinkStore::loadRules(QSettings &settings)
+{
+    std::vector<OPCUALinkRule> rules;
+
+    int count = settings.beginReadArray("Rules");
+    for (int i = 0; i < count; i++)
+    {
+        settings.setArrayIndex(i);
+
+        OPCUALinkRule rule;
+        rule.path = settings.value("Path").toString().toStdString();
+        rule.pattern = settings.value("Pattern", "*").toString().toStdString();
+        rule.regex = settings.value("Regex", false).toBool();
+        rule.ns = settings.value("Namespace", -1).toInt();
+        rule.datatype = settings.value("DataType").toString().toStdString();
+        rule.options = readOptions(settings);
+
+        rules.push_back(rule);
+    }
+    settings.endArray();
+
+    return rules;
+}
+
+void OPCUALinkStore::saveRules(QSettings &settings, const std::vector<OPCUALinkRule> &rules)
+{
+    settings.remove("Rules");
+
+    settings.beginWriteArray("Rules", static_cast<int>(rules.size()));
+    for (size_t i = 0; i < rules.size(); i++)
+    {
+        const OPCUALinkRule &rule = rules[i];
+        settings.setArrayIndex(static_cast<int>(i));
+
+        settings.setValue("Path", QString::fromStdString(rule.path));
+        settings.setValue("Pattern", QString::fromStdString(rule.pattern));
+        settings.setValue("Regex", rule.regex);
+        settings.setValue("Namespace", rule.ns);
+        settings.setValue("DataType", QString::fromStdString(rule.datatype));
+        writeOptions(settings, rule.options);
+    }
+    settings.endArray();
+}
+
+std::vector<OPCUALinkSet> OPCUALinkStore::group(const std::map<std::string, OPCUALinkOptions> &links)
+{
+    // Few distinct options in practice, a linear search per link is enough
+    std::vector<OPCUALinkSet> sets;
+
+    for (const auto &link : links)
+    {
+        auto set = sets.begin();
+        while (set != sets.end() && !(set->options == link.second))
+            ++set;
+
+        if (set == sets.end())
+        {
+            sets.push_back(OPCUALinkSet());
+            set = sets.end() - 1;
+            set->options = link.second;
+        }
+
+        set->nodes.push_back(OpcUa::ToNodeId(link.first));
+    }
+
+    return sets;
+}
+
+std::vector<OpcUa::NodeId> OPCUALinkStore::readNodeFile(const QString &file)
+{
+    std::vector<OpcUa::NodeId> nodes;
+
+    QFile in(file);
+    if (!in.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        qDebug() << "OPCUA: Can't open node file" << file;
+        return nodes;
+    }
+
+    // One NodeId per line, # starts a comment
+    QTextStream stream(&in);
+    while (!stream.atEnd())
+    {
+        QString line = stream.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        try
+        {
+            nodes.push_back(OpcUa::ToNodeId(line.toStdString()));
+        }
+        catch (const std::exception &e)
+        {
+            qDebug() << "OPCUA: Invalid NodeId" << line << "in" << file << e.what();
+        }
+    }
+
+    return nodes;
+}
+
+OPCUALinkOptions OPCUALinkStore::readOptions(QSettings &settings)
+{
+    OPCUALinkOptions options;
+    options.poll = settings.value("Poll", options.poll).toBool();
+    options.period = settings.value("Period", options.period).toUInt();
+    options.samplinginterval = settings.value("SamplingInterval", options.samplinginterval).toDouble();
+    options.queuesize = settings.value("QueueSize", options.queuesize).toUInt();
+    options.discardoldest = settings.value("DiscardOldest", options.discardoldest).toBool();
+    options.coalesce = settings.value("Coalesce", options.coalesce).toBool();
+    options.trigger = static_cast<OpcUa::DataChangeTrigger>(settings.value("Trigger", static_cast<int>(options.trigger)).toInt());
+    options.deadband = static_cast<OpcUa::DeadbandType>(settings.value("Deadband", static_cast<int>(options.deadband)).toInt());
+    options.deadbandvalue = settings.value("DeadbandValue", options.deadbandvalue).toDouble();
+
+    return options;
+}
+
+void OPCUALinkStore::writeOptions(QSettings &settings, const OPCUALinkOptions &options)
+{
+    settings.setValue("Poll", options.poll);
+    settings.setValue("Period", options.period);
+    settings.setValue("SamplingInterval", options.samplinginterval);
+    settings.setValue("QueueSize", options.queuesize);
+    settings.setValue("DiscardOldest", options.discardoldest);
+    settings.setValue("Coalesce", options.coalesce);
+    settings.setValue("Trigger", static_cast<int>(options.trigger));
+    settings.setValue("Deadband", static_cast<int>(options.deadband));
+    settings.setValue("DeadbandValue", options.deadbandvalue);
+}
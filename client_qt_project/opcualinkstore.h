@@ -0,0 +1,62 @@
+#ifndef OPCUALINKSTORE_H
+#define OPCUALINKSTORE_H
+
+#include <QSettings>
+#include <QString>
+#include <string>
+#include <vector>
+#include <map>
+#include <opc/ua/protocol/nodeid.h>
+#include "opcuasubscription.h"
+
+// --------------------------------------------------------
+// One link set, nodes linked in bulk with the same options
+// --------------------------------------------------------
+struct OPCUALinkSet
+{
+    std::vector<OpcUa::NodeId> nodes;
+    OPCUALinkOptions options;
+};
+
+// --------------------------------------------------------
+// Link rule, selects nodes by browse path, name, namespace & data type
+// The path is a prefix of browse names joined by '/' from the browse start
+// node, the pattern is a glob or a regex on the browse name.
+// --------------------------------------------------------
+struct OPCUALinkRule
+{
+    std::string path;
+    std::string pattern;
+    bool regex;
+    int ns;                 // -1 for any namespace
+    std::string datatype;   // DataType NodeId as text, empty for any
+    OPCUALinkOptions options;
+
+    OPCUALinkRule() : pattern("*"), regex(false), ns(-1) {}
+};
+
+// --------------------------------------------------------
+// OPCUALinkStore class, reads & writes link sets as a "Links" INI array
+// Each entry holds the link options & the NodeIds as a string list, or a
+// NodeFile with one NodeId per line. Link rules are kept in a "Rules" array
+// with the same option keys. The GUI keeps one such file per server, the
+// daemon reads the same entries from its config file.
+// --------------------------------------------------------
+class OPCUALinkStore
+{
+
+public:
+    static std::vector<OPCUALinkSet> load(QSettings &settings);
+    static void save(QSettings &settings, const std::vector<OPCUALinkSet> &sets);
+    static std::vector<OPCUALinkRule> loadRules(QSettings &settings);
+    static void saveRules(QSettings &settings, const std::vector<OPCUALinkRule> &rules);
+    static std::vector<OPCUALinkSet> group(const std::map<std::string, OPCUALinkOptions> &links);
+    static std::vector<OpcUa::NodeId> readNodeFile(const QString &file);
+
+private:
+    static OPCUALinkOptions readOptions(QSettings &settings);
+    static void writeOptions(QSettings &settings, const OPCUALinkOptions &options);
+
+};
+
+#endif // OPCUALINKSTORE_H
@@ -0,0 +1,459 @@
+#include "opcuanodemodel.h"
+#include <QColor>
+#include <opc/ua/protocol/string_utils.h>
+
+// --------------------------------------------------------
+// Node tree model class below
+// --------------------------------------------------------
+OPCUANodeModel::OPCUANodeModel(QObject *parent) :
+    QAbstractItemModel(parent),
+    m_nodes(std::vector<TreeNode>()),
+    m_children(std::vector<int>()),
+    m_index(std::unordered_map<std::string, int>()),
+    m_values(std::unordered_map<int, QString>()),
+    m_lazy(false)
+{
+    clear();
+}
+
+OPCUANodeModel::~OPCUANodeModel()
+{
+
+}
+
+void OPCUANodeModel::clear()
+{
+    beginResetModel();
+    clearNodes();
+    endResetModel();
+}
+
+void OPCUANodeModel::clearNodes()
+{
+    m_nodes.clear();
+    m_children.clear();
+    m_index.clear();
+    m_values.clear();
+
+    TreeNode root;
+    root.key = nullptr;
+    root.parent = -1;
+    root.row = 0;
+    root.firstchild = 0;
+    root.childcount = 0;
+    root.handle = 0;
+    root.idstart = 0;
+    root.idlength = 0;
+    root.ns = 0;
+    root.nodeclass = static_cast<uint8_t>(OpcUa::NodeClass::Unspecified);
+    root.fetched = true;
+    m_nodes.push_back(root);
+}
+
+void OPCUANodeModel::addNodes(const std::vector<OPCUABrowseNode> &nodes)
+{
+    // Siblings arrive next to each other, insert each run of them at once
+    size_t first = 0;
+    while (first < nodes.size())
+    {
+        size_t last = first + 1;
+        while (last < nodes.size() && nodes[last].parentkey == nodes[first].parentkey)
+            last++;
+
+        int parent = findParent(nodes[first].parentkey);
+        int row = m_nodes[parent].childcount;
+        beginInsertRows(indexOf(parent), row, row + static_cast<int>(last - first) - 1);
+
+        // Lazy tree, children of anything but the start node are browsed when expanded
+        for (size_t i = first; i < last; i++)
+            appendNode(parent, nodes[i].key, nodes[i].name, nodes[i].nodeclass, !m_lazy || nodes[i].parentkey.empty());
+
+        endInsertRows();
+
+        first = last;
+    }
+}
+
+void OPCUANodeModel::reset(const std::vector<OPCUABrowseNode> &nodes)
+{
+    // Links & read values follow their node into the new table
+    std::unordered_map<std::string, uint32_t> handles;
+    for (size_t i = 1; i < m_nodes.size(); i++)
+    {
+        if (m_nodes[i].handle != 0)
+            handles[*m_nodes[i].key] = m_nodes[i].handle;
+    }
+
+    std::unordered_map<std::string, QString> values;
+    for (const auto &value : m_values)
+        values[*m_nodes[value.first].key] = value.second;
+
+    beginResetModel();
+    clearNodes();
+
+    for (const OPCUABrowseNode &node : nodes)
+        appendNode(findParent(node.parentkey), node.key, node.name, node.nodeclass, !m_lazy || node.parentkey.empty());
+
+    for (size_t i = 1; i < m_nodes.size(); i++)
+    {
+        auto handle = handles.find(*m_nodes[i].key);
+        if (handle != handles.end())
+            m_nodes[i].handle = handle->second;
+
+        auto value = values.find(*m_nodes[i].key);
+        if (value != values.end())
+            m_values[static_cast<int>(i)] = value->second;
+    }
+
+    endResetModel();
+}
+
+bool OPCUANodeModel::matches(const std::vector<OPCUABrowseNode> &nodes) const
+{
+    // Same nodes under the same parents with the same names, in any order
+    if (nodes.size() != m_nodes.size() - 1)
+        return false;
+
+    for (const OPCUABrowseNode &node : nodes)
+    {
+        auto found = m_index.find(node.key);
+        if (found == m_index.end())
+            return false;
+
+        const TreeNode &item = m_nodes[found->second];
+        const std::string &parentkey = item.parent > 0 ? *m_nodes[item.parent].key : std::string();
+        if (item.name != node.name || parentkey != node.parentkey)
+            return false;
+    }
+
+    return true;
+}
+
+QModelIndex OPCUANodeModel::addNode(const QModelIndex &parent, const OpcUa::NodeId &id, const std::string &name, OpcUa::NodeClass nodeclass)
+{
+    int parentnode = nodeOf(parent);
+    int row = m_nodes[parentnode].childcount;
+
+    beginInsertRows(indexOf(parentnode), row, row);
+    int node = appendNode(parentnode, OpcUa::ToString(id), name, nodeclass, true);
+    endInsertRows();
+
+    return indexOf(node);
+}
+
+void OPCUANodeModel::setLazy(bool lazy)
+{
+    m_lazy = lazy;
+}
+
+void OPCUANodeModel::setHandle(const QModelIndex &index, uint32_t handle)
+{
+    int node = nodeOf(index);
+    if (node == 0)
+        return;
+
+    m_nodes[node].handle = handle;
+
+    QModelIndex value = indexOf(node, 3);
+    emit dataChanged(value, value);
+}
+
+void OPCUANodeModel::setValue(const QModelIndex &index, const QString &value)
+{
+    int node = nodeOf(index);
+    if (node == 0)
+        return;
+
+    m_values[node] = value;
+
+    QModelIndex changed = indexOf(node, 3);
+    emit dataChanged(changed, changed);
+}
+
+bool OPCUANodeModel::getLazy() const
+{
+    return m_lazy;
+}
+
+OpcUa::NodeId OPCUANodeModel::getNodeId(const QModelIndex &index) const
+{
+    int node = nodeOf(index);
+    if (node == 0)
+        return OpcUa::NodeId();
+
+    return OpcUa::ToNodeId(*m_nodes[node].key);
+}
+
+std::string OPCUANodeModel::getName(const QModelIndex &index) const
+{
+    return m_nodes[nodeOf(index)].name;
+}
+
+uint32_t OPCUANodeModel::getHandle(const QModelIndex &index) const
+{
+    return m_nodes[nodeOf(index)].handle;
+}
+
+OpcUa::NodeClass OPCUANodeModel::getNodeClass(const QModelIndex &index) const
+{
+    return static_cast<OpcUa::NodeClass>(m_nodes[nodeOf(index)].nodeclass);
+}
+
+bool OPCUANodeModel::hasValue(const QModelIndex &index) const
+{
+    return m_values.find(nodeOf(index)) != m_values.end();
+}
+
+QModelIndex OPCUANodeModel::find(const std::string &key) const
+{
+    // A node reached over several references is found at its last row
+    auto found = m_index.find(key);
+    return found != m_index.end() ? indexOf(found->second) : QModelIndex();
+}
+
+size_t OPCUANodeModel::getNodeCount() const
+{
+    return m_nodes.size() - 1;
+}
+
+QModelIndex OPCUANodeModel::index(int row, int column, const QModelIndex &parent) const
+{
+    const TreeNode &node = m_nodes[nodeOf(parent)];
+    if (row < 0 || row >= node.childcount || column < 0 || column >= columnCount())
+        return QModelIndex();
+
+    return createIndex(row, column, static_cast<quintptr>(m_children[node.firstchild + row]));
+}
+
+QModelIndex OPCUANodeModel::parent(const QModelIndex &index) const
+{
+    int node = nodeOf(index);
+    if (node == 0)
+        return QModelIndex();
+
+    return indexOf(m_nodes[node].parent);
+}
+
+int OPCUANodeModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.column() > 0)
+        return 0;
+
+    return m_nodes[nodeOf(parent)].childcount;
+}
+
+int OPCUANodeModel::columnCount(const QModelIndex &parent) const
+{
+    (void) parent;
+
+    return 4;
+}
+
+QVariant OPCUANodeModel::data(const QModelIndex &index, int role) const
+{
+    int node = nodeOf(index);
+    if (node == 0)
+        return QVariant();
+
+    const TreeNode &item = m_nodes[node];
+    auto value = m_values.find(node);
+
+    if (role == Qt::DisplayRole)
+    {
+        switch (index.column())
+        {
+        case 0:
+            return QString::fromUtf8(item.key->data() + item.idstart, (int) item.idlength);
+        case 1:
+            return QString::number(item.ns);
+        case 2:
+            return QString::fromStdString(item.name);
+        case 3:
+            return value != m_values.end() ? value->second : QString();
+        }
+    }
+    else if (role == Qt::BackgroundRole && index.column() == 3 && value != m_values.end() && !value->second.isEmpty())
+    {
+        return item.handle == 0 ? QColor(192, 255, 64) : QColor(64, 192, 255);
+    }
+
+    return QVariant();
+}
+
+QVariant OPCUANodeModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return QVariant();
+
+    switch (section)
+    {
+    case 0:
+        return QString("NdIdx");
+    case 1:
+        return QString("NsIdx");
+    case 2:
+        return QString("Name");
+    case 3:
+        return QString("Value");
+    }
+
+    return QVariant();
+}
+
+Qt::ItemFlags OPCUANodeModel::flags(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return Qt::NoItemFlags;
+
+    return Qt::ItemIsEnabled | Qt::ItemIsSelectable;
+}
+
+bool OPCUANodeModel::hasChildren(const QModelIndex &parent) const
+{
+    return rowCount(parent) > 0 || canFetchMore(parent);
+}
+
+bool OPCUANodeModel::canFetchMore(const QModelIndex &parent) const
+{
+    int node = nodeOf(parent);
+    if (node == 0)
+        return false;
+
+    return !m_nodes[node].fetched && mayHaveChildren(m_nodes[node].nodeclass);
+}
+
+void OPCUANodeModel::fetchMore(const QModelIndex &parent)
+{
+    int node = nodeOf(parent);
+    if (node == 0 || m_nodes[node].fetched)
+        return;
+
+    // Asked only once, the children come in later with addNodes
+    m_nodes[node].fetched = true;
+
+    emit childrenRequested(indexOf(node));
+}
+
+int OPCUANodeModel::appendNode(int parent, const std::string &key, const std::string &name, OpcUa::NodeClass nodeclass, bool fetched)
+{
+    int node = static_cast<int>(m_nodes.size());
+
+    // A node reached over several paths is found by its last row
+    auto found = m_index.insert(std::make_pair(key, node)).first;
+    found->second = node;
+
+    TreeNode item;
+    item.key = &found->first;
+    item.name = name;
+    item.parent = parent;
+    item.row = m_nodes[parent].childcount;
+    item.firstchild = 0;
+    item.childcount = 0;
+    item.handle = 0;
+    parseId(key, item);
+    item.nodeclass = static_cast<uint8_t>(nodeclass);
+    item.fetched = fetched;
+    m_nodes.push_back(item);
+
+    // Move the sibling range to the end of the child index to grow it
+    TreeNode &owner = m_nodes[parent];
+    if (owner.firstchild + owner.childcount != static_cast<int>(m_children.size()))
+    {
+        int first = static_cast<int>(m_children.size());
+        for (int i = 0; i < owner.childcount; i++)
+        {
+            int child = m_children[owner.firstchild + i];
+            m_children.push_back(child);
+        }
+
+        owner.firstchild = first;
+    }
+
+    m_children.push_back(node);
+    owner.childcount++;
+
+    return node;
+}
+
+int OPCUANodeModel::findParent(const std::string &parentkey) const
+{
+    // The start node of a walk and orphans go to the top level
+    if (parentkey.empty())
+        return 0;
+
+    auto found = m_index.find(parentkey);
+    return found != m_index.end() ? found->second : 0;
+}
+
+int OPCUANodeModel::nodeOf(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return 0;
+
+    return static_cast<int>(index.internalId());
+}
+
+QModelIndex OPCUANodeModel::indexOf(int node, int column) const
+{
+    if (node <= 0)
+        return QModelIndex();
+
+    return createIndex(m_nodes[node].row, column, static_cast<quintptr>(node));
+}
+
+bool OPCUANodeModel::mayHaveChildren(uint8_t nodeclass)
+{
+    switch (static_cast<OpcUa::NodeClass>(nodeclass))
+    {
+    case OpcUa::NodeClass::Method:
+    case OpcUa::NodeClass::DataType:
+    case OpcUa::NodeClass::ReferenceType:
+        return false;
+    default:
+        return true;
+    }
+}
+
+void OPCUANodeModel::parseId(const std::string &key, TreeNode &item)
+{
+    OpcUa::NodeId id = OpcUa::ToNodeId(key);
+    item.ns = id.GetNamespaceIndex();
+
+    // Guid & opaque ids are shown in full
+    item.idstart = 0;
+    item.idlength = static_cast<uint32_t>(key.size());
+
+    // Numeric & string ids show just the identifier, found after its i= or s=
+    std::string text;
+    const char *prefix;
+    if (id.IsInteger())
+    {
+        text = std::to_string(id.GetIntegerIdentifier());
+        prefix = "i=";
+    }
+    else if (id.IsString())
+    {
+        text = id.GetStringIdentifier();
+        prefix = "s=";
+    }
+    else
+    {
+        return;
+    }
+
+    size_t start = 2;
+    if (key.compare(0, 2, prefix) != 0)
+    {
+        start = key.find(std::string(";") + prefix);
+        if (start == std::string::npos)
+            return;
+
+        start += 3;
+    }
+
+    if (key.compare(start, text.size(), text) == 0)
+    {
+        item.idstart = static_cast<uint32_t>(start);
+        item.idlength = static_cast<uint32_t>(text.size());
+    }
+}
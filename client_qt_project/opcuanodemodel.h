@@ -0,0 +1,94 @@
+#ifndef OPCUANODEMODEL_H
+#define OPCUANODEMODEL_H
+
+#include <QAbstractItemModel>
+#include <QString>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <opc/ua/node.h>
+#include "opcuabrowser.h"
+
+// --------------------------------------------------------
+// OPCUANodeModel class, the node tree as an item model
+// Nodes live in one table, children of a node are a range in a shared
+// child index. A range that isn't at the end of the index when a child is
+// appended is moved there, browse results arrive grouped by parent so this
+// is rare. The NodeId is kept as text, parsed once when the row is added
+// for its namespace & where the shown identifier sits in the text.
+// Values are only kept for the rows that have been read, an empty value
+// marks a row that was read & had none.
+// --------------------------------------------------------
+class OPCUANodeModel : public QAbstractItemModel
+{
+    Q_OBJECT
+
+public:
+    OPCUANodeModel(QObject *parent = nullptr);
+    ~OPCUANodeModel();
+
+    void clear();
+    void addNodes(const std::vector<OPCUABrowseNode> &nodes);
+    void reset(const std::vector<OPCUABrowseNode> &nodes);
+    bool matches(const std::vector<OPCUABrowseNode> &nodes) const;
+    QModelIndex addNode(const QModelIndex &parent, const OpcUa::NodeId &id, const std::string &name, OpcUa::NodeClass nodeclass);
+    void setLazy(bool lazy);
+    void setHandle(const QModelIndex &index, uint32_t handle);
+    void setValue(const QModelIndex &index, const QString &value);
+    bool getLazy() const;
+    OpcUa::NodeId getNodeId(const QModelIndex &index) const;
+    std::string getName(const QModelIndex &index) const;
+    uint32_t getHandle(const QModelIndex &index) const;
+    OpcUa::NodeClass getNodeClass(const QModelIndex &index) const;
+    bool hasValue(const QModelIndex &index) const;
+    QModelIndex find(const std::string &key) const;
+    size_t getNodeCount() const;
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &index) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+
+signals:
+    void childrenRequested(const QModelIndex &index);
+
+private:
+    struct TreeNode
+    {
+        const std::string *key; // Owned by m_index
+        std::string name;
+        int parent;
+        int row;
+        int firstchild;         // Into m_children
+        int childcount;
+        uint32_t handle;        // Link handle, 0 when not linked
+        uint32_t idstart;       // Shown identifier, range of *key
+        uint32_t idlength;
+        uint16_t ns;
+        uint8_t nodeclass;
+        bool fetched;
+    };
+
+    void clearNodes();
+    int findParent(const std::string &parentkey) const;
+    int appendNode(int parent, const std::string &key, const std::string &name, OpcUa::NodeClass nodeclass, bool fetched);
+    int nodeOf(const QModelIndex &index) const;
+    QModelIndex indexOf(int node, int column = 0) const;
+    static bool mayHaveChildren(uint8_t nodeclass);
+    static void parseId(const std::string &key, TreeNode &item);
+
+    std::vector<TreeNode> m_nodes; // 0 is the invisible root
+    std::vector<int> m_children;
+    std::unordered_map<std::string, int> m_index;
+    std::unordered_map<int, QString> m_values;
+    bool m_lazy;
+
+};
+
+#endif // OPCUANODEMODEL_H
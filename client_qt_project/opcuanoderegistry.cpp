@@ -0,0 +1,214 @@
+#include "opcuanoderegistry.h"
+#include <QDebug>
+#include <algorithm>
+
+// --------------------------------------------------------
+// OPCUANodeRegistry class below
+// --------------------------------------------------------
+OPCUANodeRegistry::OPCUANodeRegistry(OpcUa::UaClient *client, unsigned int maxpercall) :
+    m_client(client),
+    m_maxpercall(maxpercall > 0 ? maxpercall : 1),
+    m_entries(std::map<std::string, Entry>()),
+    m_connected(false),
+    m_supported(true)
+{
+
+}
+
+std::vector<OpcUa::Node> OPCUANodeRegistry::acquire(const std::vector<OpcUa::Node> &nodes)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    // Only the nodes seen for the first time go to the server
+    std::vector<Entry *> fresh;
+    std::vector<Entry *> entries;
+    for (const OpcUa::Node &node : nodes)
+    {
+        Entry &entry = m_entries[node.ToString()];
+
+        if (entry.refs++ == 0)
+        {
+            entry.id = node.GetId();
+            entry.valid = false;
+            entry.kept = false;
+            fresh.push_back(&entry);
+        }
+
+        entries.push_back(&entry);
+    }
+
+    if (!fresh.empty())
+        registerEntries(fresh);
+
+    std::vector<OpcUa::Node> result;
+    result.reserve(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++)
+        result.push_back(entries[i]->valid ? OpcUa::Node(nodes[i].GetServices(), entries[i]->registered) : nodes[i]);
+
+    return result;
+}
+
+OpcUa::Node OPCUANodeRegistry::acquire(const OpcUa::Node &node)
+{
+    return acquire(std::vector<OpcUa::Node>(1, node)).front();
+}
+
+void OPCUANodeRegistry::release(const std::vector<OpcUa::Node> &nodes)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    std::vector<OpcUa::Node> unregister;
+    for (const OpcUa::Node &node : nodes)
+    {
+        auto it = m_entries.find(node.ToString());
+        if (it == m_entries.end() || --it->second.refs > 0)
+            continue;
+
+        if (it->second.valid)
+            unregister.push_back(OpcUa::Node(node.GetServices(), it->second.registered));
+
+        m_entries.erase(it);
+    }
+
+    // The server drops the registrations with the session anyway
+    if (unregister.empty() || !m_connected)
+        return;
+
+    try
+    {
+        m_client->CreateServerOperations().UnregisterNodes(unregister);
+    }
+    catch (const std::exception &exc)
+    {
+        qDebug() << "OPCUA: UnregisterNodes failed for" << unregister.size() << "nodes:" << exc.what();
+    }
+}
+
+void OPCUANodeRegistry::release(const OpcUa::Node &node)
+{
+    release(std::vector<OpcUa::Node>(1, node));
+}
+
+OpcUa::Node OPCUANodeRegistry::resolve(const OpcUa::Node &node)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    auto it = m_entries.find(node.ToString());
+    if (it == m_entries.end() || !it->second.valid)
+        return node;
+
+    return OpcUa::Node(node.GetServices(), it->second.registered);
+}
+
+OpcUa::Node OPCUANodeRegistry::keep(const OpcUa::Node &node)
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+
+        auto it = m_entries.find(node.ToString());
+        if (it != m_entries.end() && it->second.kept)
+            return it->second.valid ? OpcUa::Node(node.GetServices(), it->second.registered) : node;
+    }
+
+    // Written nodes hold one reference for as long as the registry lives
+    OpcUa::Node result = acquire(node);
+
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    m_entries[node.ToString()].kept = true;
+
+    return result;
+}
+
+void OPCUANodeRegistry::reregister()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    m_connected = true;
+    m_supported = true;
+
+    // Registered ids of the last session are meaningless now
+    std::vector<Entry *> entries;
+    for (auto &it : m_entries)
+    {
+        it.second.valid = false;
+        entries.push_back(&it.second);
+    }
+
+    if (!entries.empty())
+    {
+        registerEntries(entries);
+        qDebug() << "OPCUA: Registered" << entries.size() << "nodes again after connect";
+    }
+}
+
+void OPCUANodeRegistry::disconnect()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    m_connected = false;
+
+    for (auto &it : m_entries)
+        it.second.valid = false;
+}
+
+void OPCUANodeRegistry::clear()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    m_entries.clear();
+}
+
+void OPCUANodeRegistry::registerEntries(const std::vector<Entry *> &entries)
+{
+    if (!m_connected || !m_supported)
+        return;
+
+    for (size_t begin = 0; begin < entries.size(); begin += m_maxpercall)
+    {
+        size_t end = std::min<size_t>(begin + m_maxpercall, entries.size());
+
+        std::vector<OpcUa::Node> chunk;
+        for (size_t i = begin; i < end; i++)
+            chunk.push_back(m_client->GetNode(entries[i]->id));
+
+        try
+        {
+            std::vector<OpcUa::Node> registered = m_client->CreateServerOperations().RegisterNodes(chunk);
+
+            if (registered.size() != chunk.size())
+                throw std::runtime_error("OPCUA: RegisterNodes returned " + std::to_string(registered.size()) + " ids for " + std::to_string(chunk.size()) + " nodes.");
+
+            for (size_t i = begin; i < end; i++)
+            {
+                entries[i]->registered = registered[i - begin].GetId();
+                entries[i]->valid = true;
+            }
+        }
+        catch (const std::exception &exc)
+        {
+            // Most likely BadServiceUnsupported, don't ask again this session
+            qDebug() << "OPCUA: RegisterNodes failed, using plain node ids:" << exc.what();
+            m_supported = false;
+            return;
+        }
+    }
+}
+
+size_t OPCUANodeRegistry::getCount()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    return m_entries.size();
+}
+
+size_t OPCUANodeRegistry::getRegisteredCount()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    return std::count_if(m_entries.begin(), m_entries.end(), [](const std::pair<const std::string, Entry> &it) { return it.second.valid; });
+}
+
+bool OPCUANodeRegistry::isSupported() const
+{
+    return m_supported;
+}
@@ -0,0 +1,59 @@
+#ifndef OPCUANODEREGISTRY_H
+#define OPCUANODEREGISTRY_H
+
+#include <string>
+#include <map>
+#include <vector>
+#include <boost/thread.hpp>
+#include <opc/ua/client/client.h>
+#include <opc/ua/node.h>
+
+// --------------------------------------------------------
+// OPCUANodeRegistry class, RegisterNodes for the nodes used over and over
+// Polled, linked and written nodes are registered once and the server
+// handed NodeId is used for their reads & writes afterwards. Entries are
+// reference counted and keyed by the original NodeId, which is kept so
+// everything can be registered again in the next session. A server that
+// doesn't support RegisterNodes just gets the original nodes back.
+// --------------------------------------------------------
+class OPCUANodeRegistry
+{
+
+public:
+    OPCUANodeRegistry(OpcUa::UaClient *client = nullptr, unsigned int maxpercall = 1000);
+
+    std::vector<OpcUa::Node> acquire(const std::vector<OpcUa::Node> &nodes);
+    OpcUa::Node acquire(const OpcUa::Node &node);
+    void release(const std::vector<OpcUa::Node> &nodes);
+    void release(const OpcUa::Node &node);
+    OpcUa::Node resolve(const OpcUa::Node &node);
+    OpcUa::Node keep(const OpcUa::Node &node);
+    void reregister();
+    void disconnect();
+    void clear();
+    size_t getCount();
+    size_t getRegisteredCount();
+    bool isSupported() const;
+
+private:
+    struct Entry
+    {
+        OpcUa::NodeId id;
+        OpcUa::NodeId registered;
+        bool valid;
+        bool kept;
+        unsigned int refs;
+    };
+
+    void registerEntries(const std::vector<Entry *> &entries);
+
+    OpcUa::UaClient *m_client;
+    unsigned int m_maxpercall;
+    std::map<std::string, Entry> m_entries;
+    bool m_connected;
+    bool m_supported;
+    boost::mutex m_mutex;
+
+};
+
+#endif // OPCUANODEREGISTRY_H
@@ -0,0 +1,392 @@
+#include "opcuapoller.h"
+#include "opcuaclient.h"
+#include "opcuanoderegistry.h"
+#include <QDebug>
+#include <algorithm>
+
+// --------------------------------------------------------
+// OPCUAPoller class below
+// --------------------------------------------------------
+OPCUAPoller::OPCUAPoller(OpcUa::UaClient *client, OPCUASubClient *handler, OPCUANodeRegistry *registry, unsigned int groupsize) :
+    m_client(client),
+    m_handler(handler),
+    m_registry(registry),
+    m_groupsize(groupsize > 0 ? groupsize : 1),
+    m_groups(std::vector<std::unique_ptr<PollGroup>>()),
+    m_items(std::map<std::string, PolledItem>()),
+    m_version(0),
+    m_runstate(NOTSTARTED)
+{
+
+}
+
+OPCUAPoller::~OPCUAPoller()
+{
+    if (m_runstate == RUNNING)
+    {
+        setRunState(STOPPED);
+        wait();
+    }
+}
+
+std::vector<OPCUALinkResult> OPCUAPoller::add(const std::vector<OpcUa::Node> &nodes, const OPCUALinkOptions &options)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    OPCUALinkResult failed;
+    failed.handle = 0;
+    failed.status = OpcUa::StatusCode::BadUnexpectedError;
+    std::vector<OPCUALinkResult> results(nodes.size(), failed);
+
+    // Skip the nodes that are already polled or listed twice
+    std::map<std::string, size_t> pending;
+    std::vector<size_t> duplicates;
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        std::string key = nodes[i].ToString();
+        auto it = m_items.find(key);
+
+        if (it != m_items.end())
+        {
+            results[i].handle = it->second.handle;
+            results[i].status = OpcUa::StatusCode::Good;
+        }
+        else if (!pending.insert(std::make_pair(key, i)).second)
+        {
+            duplicates.push_back(i);
+        }
+    }
+
+    auto next = pending.begin();
+    while (next != pending.end())
+    {
+        // One group worth of nodes per BrowseName read
+        std::vector<OpcUa::Node> chunk;
+        std::vector<std::map<std::string, size_t>::iterator> entries;
+        for (; next != pending.end() && chunk.size() < m_groupsize; ++next)
+        {
+            chunk.push_back(nodes[next->second]);
+            entries.push_back(next);
+        }
+
+        try
+        {
+            // The browse name read also tells which nodes the server knows at all
+            std::vector<OpcUa::DataValue> names = m_client->CreateServerOperations().ReadAttributes(chunk, OpcUa::AttributeId::BrowseName);
+
+            if (names.size() != chunk.size())
+                throw std::runtime_error("OPCUA: Read returned " + std::to_string(names.size()) + " results for " + std::to_string(chunk.size()) + " nodes.");
+
+            std::vector<size_t> validentries;
+            std::vector<OpcUa::Node> valid;
+            std::vector<OpcUa::DataValue> validnames;
+            for (size_t i = 0; i < chunk.size(); i++)
+            {
+                results[entries[i]->second].status = names[i].Status;
+
+                if (names[i].Status != OpcUa::StatusCode::Good)
+                    continue;
+
+                validentries.push_back(i);
+                valid.push_back(chunk[i]);
+                validnames.push_back(names[i]);
+            }
+
+            std::vector<OpcUa::Node> reads = m_registry->acquire(valid);
+
+            std::vector<uint32_t> handles;
+            for (size_t i = 0; i < valid.size(); i++)
+            {
+                OPCUALinkResult &result = results[entries[validentries[i]]->second];
+                result.handle = m_handler->newHandle();
+                handles.push_back(result.handle);
+
+                // The first read always publishes
+                PollGroup *group = acquireGroup(options.period);
+                OpcUa::DataValue initial;
+                initial.Status = OpcUa::StatusCode::BadWaitingForInitialData;
+                group->nodes.push_back(valid[i]);
+                group->reads.push_back(reads[i]);
+                group->handles.push_back(result.handle);
+                group->values.push_back(initial);
+                group->version = ++m_version;
+
+                PolledItem item;
+                item.owner = group;
+                item.handle = result.handle;
+                m_items[entries[validentries[i]]->first] = item;
+            }
+
+            m_handler->registerLinks(handles, valid, validnames, options);
+        }
+        catch (const std::exception &exc)
+        {
+            // Keep the rest going, these items stay at BadUnexpectedError
+            qDebug() << "OPCUA: Adding" << chunk.size() << "polled items failed:" << exc.what();
+        }
+    }
+
+    for (size_t i : duplicates)
+        results[i] = results[pending[nodes[i].ToString()]];
+
+    return results;
+}
+
+void OPCUAPoller::remove(const OpcUa::Node &node)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    auto it = m_items.find(node.ToString());
+    if (it == m_items.end())
+        return;
+
+    PolledItem item = it->second;
+    m_items.erase(it);
+
+    PollGroup *group = item.owner;
+    size_t idx = std::find(group->handles.begin(), group->handles.end(), item.handle) - group->handles.begin();
+    m_registry->release(group->nodes[idx]);
+    group->nodes.erase(group->nodes.begin() + idx);
+    group->reads.erase(group->reads.begin() + idx);
+    group->handles.erase(group->handles.begin() + idx);
+    group->values.erase(group->values.begin() + idx);
+    group->version = ++m_version;
+    m_handler->unregisterLink(item.handle);
+
+    if (group->nodes.empty())
+    {
+        unsigned int period = group->period;
+
+        m_groups.erase(std::find_if(m_groups.begin(), m_groups.end(),
+                                    [group](const std::unique_ptr<PollGroup> &g) { return g.get() == group; }));
+        spreadGroups(period);
+    }
+}
+
+bool OPCUAPoller::isPolled(const OpcUa::Node &node)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    return m_items.find(node.ToString()) != m_items.end();
+}
+
+void OPCUAPoller::clear()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    for (auto &it : m_items)
+        m_handler->unregisterLink(it.second.handle);
+
+    for (std::unique_ptr<PollGroup> &group : m_groups)
+        m_registry->release(group->nodes);
+
+    m_items.clear();
+    m_groups.clear();
+}
+
+void OPCUAPoller::run()
+{
+    m_runstate = RUNNING;
+
+    while (m_runstate == RUNNING)
+    {
+        PollGroup *due = nullptr;
+        uint64_t version = 0;
+        std::vector<OpcUa::Node> reads;
+
+        {
+            boost::unique_lock<boost::mutex> lock(m_mutex);
+
+            // Nothing polled, add or stop wakes it up
+            while (m_runstate == RUNNING && m_groups.empty())
+                m_cond.wait(lock);
+
+            if (m_runstate != RUNNING)
+                break;
+
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+            auto next = std::min_element(m_groups.begin(), m_groups.end(),
+                                         [](const std::unique_ptr<PollGroup> &a, const std::unique_ptr<PollGroup> &b) { return a->due < b->due; });
+
+            PollGroup &group = **next;
+
+            // Sleep until the earliest group is due, a respread may make it sooner
+            if (group.due > now)
+            {
+                int sleepms = (int) std::chrono::duration_cast<std::chrono::milliseconds>(group.due - now).count() + 1;
+                m_cond.timed_wait(lock, boost::posix_time::milliseconds(sleepms));
+                continue;
+            }
+
+            due = &group;
+            version = group.version;
+            reads = group.reads;
+        }
+
+        // The network round trip runs unlocked, add/remove/isPolled don't wait for it
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::vector<OpcUa::DataValue> values;
+        bool ok = read(m_client, reads, values);
+        double readms = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / 1000.0;
+
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+
+        // Removed or changed meanwhile, the values don't line up with the members anymore
+        auto it = std::find_if(m_groups.begin(), m_groups.end(),
+                               [due, version](const std::unique_ptr<PollGroup> &g) { return g.get() == due && g->version == version; });
+        if (it == m_groups.end())
+            continue;
+
+        PollGroup &group = **it;
+        publish(group, values, ok, readms);
+
+        // A read slower than the period skips the missed polls
+        group.due += std::chrono::milliseconds(group.period);
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (group.due <= now)
+        {
+            group.stats.overruns++;
+            group.due = now + std::chrono::milliseconds(group.period);
+        }
+    }
+
+    m_runstate = FINISHED;
+}
+
+bool OPCUAPoller::read(OpcUa::UaClient *client, std::vector<OpcUa::Node> &reads, std::vector<OpcUa::DataValue> &values)
+{
+    try
+    {
+        values = client->CreateServerOperations().ReadAttributes(reads, OpcUa::AttributeId::Value);
+    }
+    catch (const std::exception &exc)
+    {
+        qDebug() << "OPCUA: Poll of" << reads.size() << "items failed:" << exc.what();
+        return false;
+    }
+
+    return true;
+}
+
+void OPCUAPoller::publish(PollGroup &group, const std::vector<OpcUa::DataValue> &values, bool ok, double readms)
+{
+    if (!ok)
+    {
+        group.stats.errors++;
+        return;
+    }
+
+    group.stats.polls++;
+    group.stats.readavg += (readms - group.stats.readavg) / group.stats.polls;
+    group.stats.readmax = std::max(group.stats.readmax, readms);
+
+    if (values.size() != group.nodes.size())
+    {
+        group.stats.errors++;
+        return;
+    }
+
+    // Publish only what changed since the last read
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        if (values[i].Status == group.values[i].Status && values[i].Value == group.values[i].Value)
+            continue;
+
+        m_handler->dataValueChange(group.handles[i], values[i]);
+        group.values[i] = values[i];
+        group.stats.changes++;
+    }
+
+    m_handler->dataChangesDone();
+}
+
+OPCUAPoller::PollGroup *OPCUAPoller::acquireGroup(unsigned int period)
+{
+    for (std::unique_ptr<PollGroup> &group : m_groups)
+    {
+        if (group->period == period && group->nodes.size() < m_groupsize)
+            return group.get();
+    }
+
+    PollGroup *group = new PollGroup();
+    group->period = period > 0 ? period : 1;
+    group->stats = OPCUAPollStats();
+    group->stats.period = group->period;
+    group->version = ++m_version;
+    m_groups.push_back(std::unique_ptr<PollGroup>(group));
+
+    spreadGroups(group->period);
+
+    return group;
+}
+
+void OPCUAPoller::spreadGroups(unsigned int period)
+{
+    std::vector<PollGroup *> groups;
+    for (std::unique_ptr<PollGroup> &group : m_groups)
+    {
+        if (group->period == period)
+            groups.push_back(group.get());
+    }
+
+    // Evenly staggered over one period
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < groups.size(); i++)
+        groups[i]->due = now + std::chrono::microseconds((uint64_t) period * 1000 * i / groups.size());
+
+    m_cond.notify_all();
+}
+
+void OPCUAPoller::setGroupSize(unsigned int groupsize)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    m_groupsize = groupsize > 0 ? groupsize : 1;
+}
+
+void OPCUAPoller::setRunState(const CLIENT_STATE state)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    m_runstate = state;
+    m_cond.notify_all();
+}
+
+CLIENT_STATE OPCUAPoller::getRunState() const
+{
+    return m_runstate;
+}
+
+unsigned int OPCUAPoller::getGroupSize() const
+{
+    return m_groupsize;
+}
+
+size_t OPCUAPoller::getGroupCount()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    return m_groups.size();
+}
+
+size_t OPCUAPoller::getItemCount()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    return m_items.size();
+}
+
+std::vector<OPCUAPollStats> OPCUAPoller::getStats()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    std::vector<OPCUAPollStats> stats;
+    for (std::unique_ptr<PollGroup> &group : m_groups)
+    {
+        stats.push_back(group->stats);
+        stats.back().items = group->nodes.size();
+    }
+
+    return stats;
+}
@@ -0,0 +1,106 @@
+#ifndef OPCUAPOLLER_H
+#define OPCUAPOLLER_H
+
+#include <QThread>
+#include <string>
+#include <map>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <boost/thread.hpp>
+#include <opc/ua/client/client.h>
+#include <opc/ua/node.h>
+#include "clientstates.h"
+#include "opcuasubpool.h"
+
+class OPCUASubClient;
+class OPCUANodeRegistry;
+
+// --------------------------------------------------------
+// Timing of one poll group, times in ms
+// --------------------------------------------------------
+struct OPCUAPollStats
+{
+    unsigned int period;
+    size_t items;
+    uint64_t polls;
+    uint64_t changes;
+    uint64_t errors;
+    uint64_t overruns;
+    double readavg;
+    double readmax;
+};
+
+// --------------------------------------------------------
+// OPCUAPoller class, polled acquisition for servers with weak subscriptions
+// Links are packed into groups of at most groupsize nodes per period, each
+// group is read with a single ReadAttributes call and only the values that
+// changed since the last read are passed on to the sub client. Groups of
+// the same period are spread evenly over it to avoid bursts. The nodes
+// are read through their registered ids where the server supports it.
+// The read runs without the lock, so linking from the GUI never waits on
+// the network. A group whose members changed meanwhile (its version moved
+// on) drops that read & is read again. Without groups the thread sleeps
+// until one is added, otherwise until the next group is due.
+// --------------------------------------------------------
+class OPCUAPoller : public QThread
+{
+    Q_OBJECT
+
+public:
+    OPCUAPoller(OpcUa::UaClient *client = nullptr, OPCUASubClient *handler = nullptr, OPCUANodeRegistry *registry = nullptr, unsigned int groupsize = 100);
+    ~OPCUAPoller();
+
+    std::vector<OPCUALinkResult> add(const std::vector<OpcUa::Node> &nodes, const OPCUALinkOptions &options);
+    void remove(const OpcUa::Node &node);
+    bool isPolled(const OpcUa::Node &node);
+    void clear();
+    void setGroupSize(unsigned int groupsize);
+    void setRunState(const CLIENT_STATE state);
+    CLIENT_STATE getRunState() const;
+    unsigned int getGroupSize() const;
+    size_t getGroupCount();
+    size_t getItemCount();
+    std::vector<OPCUAPollStats> getStats();
+
+private:
+    struct PollGroup
+    {
+        unsigned int period;
+        std::chrono::steady_clock::time_point due;
+        std::vector<OpcUa::Node> nodes;
+        std::vector<OpcUa::Node> reads; // registered ids of nodes
+        std::vector<uint32_t> handles;
+        std::vector<OpcUa::DataValue> values;
+        OPCUAPollStats stats;
+        uint64_t version; // from m_version, changes with the members
+    };
+
+    struct PolledItem
+    {
+        PollGroup *owner;
+        uint32_t handle;
+    };
+
+    PollGroup *acquireGroup(unsigned int period);
+    void spreadGroups(unsigned int period);
+    static bool read(OpcUa::UaClient *client, std::vector<OpcUa::Node> &reads, std::vector<OpcUa::DataValue> &values);
+    void publish(PollGroup &group, const std::vector<OpcUa::DataValue> &values, bool ok, double readms);
+
+    OpcUa::UaClient *m_client;
+    OPCUASubClient *m_handler;
+    OPCUANodeRegistry *m_registry;
+    unsigned int m_groupsize;
+    std::vector<std::unique_ptr<PollGroup>> m_groups;
+    std::map<std::string, PolledItem> m_items;
+    boost::mutex m_mutex;
+    boost::condition_variable m_cond; // groups added or respread, stop
+    uint64_t m_version;
+    volatile CLIENT_STATE m_runstate;
+
+protected:
+    void run() override;
+
+};
+
+#endif // OPCUAPOLLER_H
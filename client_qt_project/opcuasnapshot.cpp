@@ -0,0 +1,165 @@
+#include "opcuasnapshot.h"
+#include <QDebug>
+#include <cstdio>
+#include <fstream>
+#include <unordered_map>
+#include <opc/ua/protocol/string_utils.h>
+
+namespace
+{
+
+const char s_magic[4] = { 'O', 'U', 'M', 'S' };
+const uint32_t s_version = 1;
+
+// --------------------------------------------------------
+// Fixed width integers & length prefixed strings, host byte order
+// --------------------------------------------------------
+template<typename T>
+void writeInt(std::ostream &out, T value)
+{
+    out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void writeString(std::ostream &out, const std::string &value)
+{
+    writeInt<uint32_t>(out, static_cast<uint32_t>(value.size()));
+    out.write(value.data(), value.size());
+}
+
+template<typename T>
+bool readInt(std::istream &in, T &value)
+{
+    return static_cast<bool>(in.read(reinterpret_cast<char *>(&value), sizeof(value)));
+}
+
+bool readString(std::istream &in, std::string &value)
+{
+    uint32_t len;
+    if (!readInt(in, len) || len > (1u << 20))
+        return false;
+
+    value.resize(len);
+    return len == 0 || static_cast<bool>(in.read(&value[0], len));
+}
+
+}
+
+// --------------------------------------------------------
+// Address space snapshot class below
+// --------------------------------------------------------
+bool OPCUASnapshot::save(const std::string &file, const std::string &uri, const std::vector<OPCUABrowseNode> &nodes)
+{
+    std::string temp = file + ".tmp";
+
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        if (!out)
+        {
+            qDebug() << "OPCUA: Can't write the snapshot" << temp.c_str();
+            return false;
+        }
+
+        out.write(s_magic, sizeof(s_magic));
+        writeInt<uint32_t>(out, s_version);
+        writeString(out, uri);
+        writeInt<uint32_t>(out, static_cast<uint32_t>(nodes.size()));
+
+        // Parents by their position in the file, nodes reached twice point to the first
+        std::unordered_map<std::string, int32_t> positions;
+        for (size_t i = 0; i < nodes.size(); i++)
+        {
+            const OPCUABrowseNode &node = nodes[i];
+
+            auto parent = positions.find(node.parentkey);
+            positions.insert(std::make_pair(node.key, static_cast<int32_t>(i)));
+
+            writeString(out, node.key);
+            writeInt<int32_t>(out, parent != positions.end() ? parent->second : -1);
+            writeString(out, node.name);
+            writeInt<int32_t>(out, static_cast<int32_t>(node.nodeclass));
+            writeString(out, node.nodeclass == OpcUa::NodeClass::Variable ? OpcUa::ToString(node.datatype) : std::string());
+        }
+
+        if (!out.flush())
+        {
+            qDebug() << "OPCUA: Writing the snapshot" << temp.c_str() << "failed";
+            return false;
+        }
+    }
+
+    // Readers never see a half written snapshot
+    std::remove(file.c_str());
+    if (std::rename(temp.c_str(), file.c_str()) != 0)
+    {
+        qDebug() << "OPCUA: Can't replace the snapshot" << file.c_str();
+        return false;
+    }
+
+    return true;
+}
+
+bool OPCUASnapshot::load(const std::string &file, const std::string &uri, std::vector<OPCUABrowseNode> &nodes)
+{
+    nodes.clear();
+
+    std::ifstream in(file, std::ios::binary);
+    if (!in)
+        return false;
+
+    char magic[4];
+    uint32_t version;
+    std::string fileuri;
+    uint32_t count;
+    if (!in.read(magic, sizeof(magic)) || std::string(magic, sizeof(magic)) != std::string(s_magic, sizeof(s_magic))
+            || !readInt(in, version) || version != s_version
+            || !readString(in, fileuri) || fileuri != uri
+            || !readInt(in, count))
+    {
+        qDebug() << "OPCUA: Snapshot" << file.c_str() << "is not for this server or version";
+        return false;
+    }
+
+    try
+    {
+        nodes.reserve(count);
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            OPCUABrowseNode node;
+            int32_t parent;
+            int32_t nodeclass;
+            std::string datatype;
+
+            if (!readString(in, node.key) || !readInt(in, parent) || !readString(in, node.name)
+                    || !readInt(in, nodeclass) || !readString(in, datatype) || parent >= static_cast<int32_t>(i))
+            {
+                qDebug() << "OPCUA: Snapshot" << file.c_str() << "is truncated at node" << i;
+                nodes.clear();
+                return false;
+            }
+
+            node.id = OpcUa::ToNodeId(node.key);
+            node.nodeclass = static_cast<OpcUa::NodeClass>(nodeclass);
+            node.depth = 0;
+
+            if (parent >= 0)
+            {
+                node.parentkey = nodes[parent].key;
+                node.depth = nodes[parent].depth + 1;
+            }
+
+            if (!datatype.empty())
+                node.datatype = OpcUa::ToNodeId(datatype);
+
+            nodes.push_back(node);
+        }
+    }
+    catch (const std::exception &exc)
+    {
+        qDebug() << "OPCUA: Snapshot" << file.c_str() << "is corrupt:" << exc.what();
+        nodes.clear();
+        return false;
+    }
+
+    return true;
+}
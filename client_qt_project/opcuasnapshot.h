@@ -0,0 +1,26 @@
+#ifndef OPCUASNAPSHOT_H
+#define OPCUASNAPSHOT_H
+
+#include <string>
+#include <vector>
+#include "opcuabrowser.h"
+
+// --------------------------------------------------------
+// OPCUASnapshot class, stores a browsed address space in a binary file
+// The file holds the server URI, then per node the NodeId, parent,
+// browse name, node class & data type. Parents are written as the index
+// of an earlier node, so nodes must be saved in browse order & are loaded
+// back in the same order, ready for OPCUANodeModel::addNodes. The file is
+// read sequentially, a file of another server or version is rejected.
+// save writes to a temporary file first & replaces the old one after.
+// --------------------------------------------------------
+class OPCUASnapshot
+{
+
+public:
+    static bool save(const std::string &file, const std::string &uri, const std::vector<OPCUABrowseNode> &nodes);
+    static bool load(const std::string &file, const std::string &uri, std::vector<OPCUABrowseNode> &nodes);
+
+};
+
+#endif // OPCUASNAPSHOT_H
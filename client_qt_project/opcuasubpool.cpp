@@ -0,0 +1,275 @@
+#include "opcuasubpool.h"
+#include "opcuaclient.h"
+#include "opcuanoderegistry.h"
+#include <QDebug>
+#include <opc/ua/protocol/string_utils.h>
+
+// --------------------------------------------------------
+// OPCUASubPool class below
+// --------------------------------------------------------
+OPCUASubPool::OPCUASubPool(OpcUa::UaClient *client, OPCUASubClient *handler, OPCUANodeRegistry *registry, unsigned int maxitems, unsigned int maxpercall) :
+    m_client(client),
+    m_handler(handler),
+    m_registry(registry),
+    m_maxitems(maxitems > 0 ? maxitems : 1),
+    m_maxpercall(maxpercall > 0 ? maxpercall : 1),
+    m_subs(std::map<unsigned int, std::vector<std::unique_ptr<PooledSub>>>()),
+    m_items(std::map<std::string, PooledItem>())
+{
+
+}
+
+OPCUASubPool::~OPCUASubPool()
+{
+    clear();
+}
+
+uint32_t OPCUASubPool::subscribe(const OpcUa::Node &node, const OPCUALinkOptions &options)
+{
+    OPCUALinkResult result = subscribe(std::vector<OpcUa::Node>(1, node), options).front();
+
+    if (result.status != OpcUa::StatusCode::Good)
+        throw std::runtime_error("OPCUA: Failed to link " + node.ToString() + " (" + OpcUa::ToString(result.status) + ")");
+
+    return result.handle;
+}
+
+std::vector<OPCUALinkResult> OPCUASubPool::subscribe(const std::vector<OpcUa::Node> &nodes, const OPCUALinkOptions &options)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    OPCUALinkResult failed;
+    failed.handle = 0;
+    failed.status = OpcUa::StatusCode::BadUnexpectedError;
+    std::vector<OPCUALinkResult> results(nodes.size(), failed);
+
+    // Skip the nodes that are already linked or listed twice
+    std::map<std::string, size_t> pending;
+    std::vector<size_t> duplicates;
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        std::string key = nodes[i].ToString();
+        auto it = m_items.find(key);
+
+        if (it != m_items.end())
+        {
+            results[i].handle = it->second.handle;
+            results[i].status = OpcUa::StatusCode::Good;
+        }
+        else if (!pending.insert(std::make_pair(key, i)).second)
+        {
+            duplicates.push_back(i);
+        }
+    }
+
+    auto next = pending.begin();
+    while (next != pending.end())
+    {
+        PooledSub *pooled = acquireSub(options.period);
+        unsigned int room = std::min(m_maxitems - pooled->items, m_maxpercall);
+
+        // Fill one chunk, at most the room left in the subscription
+        std::vector<OpcUa::Node> chunk;
+        std::vector<uint32_t> handles;
+        std::vector<std::map<std::string, size_t>::iterator> entries;
+        for (; next != pending.end() && chunk.size() < room; ++next)
+        {
+            chunk.push_back(nodes[next->second]);
+            handles.push_back(m_handler->newHandle());
+            entries.push_back(next);
+        }
+
+        bool registered = false;
+
+        try
+        {
+            // Resolve the link metadata before any notification can arrive
+            std::vector<OpcUa::DataValue> names = m_client->CreateServerOperations().ReadAttributes(chunk, OpcUa::AttributeId::BrowseName);
+            m_handler->registerLinks(handles, chunk, names, options);
+
+            std::vector<OpcUa::Node> monitored = m_registry->acquire(chunk);
+            registered = true;
+
+            std::vector<OpcUa::MonitoredItemCreateResult> created = pooled->sub->subscribeItems(monitored, handles, options);
+
+            for (size_t i = 0; i < created.size(); i++)
+            {
+                OPCUALinkResult &result = results[entries[i]->second];
+                result.status = created[i].Status;
+
+                if (created[i].Status == OpcUa::StatusCode::Good)
+                {
+                    PooledItem item;
+                    item.node = chunk[i];
+                    item.owner = pooled;
+                    item.handle = handles[i];
+                    m_items[entries[i]->first] = item;
+                    pooled->items++;
+
+                    result.handle = handles[i];
+                }
+                else
+                {
+                    m_handler->unregisterLink(handles[i]);
+                    m_registry->release(chunk[i]);
+                }
+            }
+        }
+        catch (const std::exception &exc)
+        {
+            for (uint32_t handle : handles)
+                m_handler->unregisterLink(handle);
+
+            if (registered)
+                m_registry->release(chunk);
+
+            // Keep the rest of the batch going, these items stay at BadUnexpectedError
+            qDebug() << "OPCUA: CreateMonitoredItems failed for" << chunk.size() << "items:" << exc.what();
+        }
+
+        // Nothing made it into a freshly opened subscription
+        if (pooled->items == 0)
+            releaseSub(pooled);
+    }
+
+    for (size_t i : duplicates)
+        results[i] = results[pending[nodes[i].ToString()]];
+
+    return results;
+}
+
+void OPCUASubPool::unsubscribe(const OpcUa::Node &node)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    auto it = m_items.find(node.ToString());
+    if (it == m_items.end())
+        return;
+
+    PooledItem item = it->second;
+    m_items.erase(it);
+
+    item.owner->sub->unsubscribeItem(item.handle);
+    item.owner->items--;
+    m_handler->unregisterLink(item.handle);
+    m_registry->release(item.node);
+
+    // Close the server subscription once its last item is gone
+    if (item.owner->items == 0)
+        releaseSub(item.owner);
+}
+
+bool OPCUASubPool::isSubscribed(const OpcUa::Node &node)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    return m_items.find(node.ToString()) != m_items.end();
+}
+
+void OPCUASubPool::clear()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    // The server side subscriptions are gone with the session, only local state is dropped
+    std::vector<OpcUa::Node> nodes;
+    for (auto &it : m_items)
+        nodes.push_back(it.second.node);
+
+    if (m_registry)
+        m_registry->release(nodes);
+
+    m_items.clear();
+    m_subs.clear();
+
+    if (m_handler)
+        m_handler->clearLinks();
+}
+
+OPCUASubPool::PooledSub *OPCUASubPool::acquireSub(unsigned int period)
+{
+    std::vector<std::unique_ptr<PooledSub>> &subs = m_subs[period];
+
+    for (std::unique_ptr<PooledSub> &pooled : subs)
+    {
+        if (pooled->items < m_maxitems)
+            return pooled.get();
+    }
+
+    qDebug() << "OPCUA: Opening subscription" << subs.size() << "for publishing interval" << period << "ms";
+
+    OpcUa::CreateSubscriptionParameters params;
+    params.RequestedPublishingInterval = period;
+
+    std::unique_ptr<PooledSub> pooled(new PooledSub());
+    pooled->sub.reset(new OPCUASubscription(m_client->GetRootNode().GetServices(), params, *m_handler));
+    pooled->period = period;
+    pooled->items = 0;
+    subs.push_back(std::move(pooled));
+
+    return subs.back().get();
+}
+
+void OPCUASubPool::releaseSub(PooledSub *pooled)
+{
+    unsigned int period = pooled->period;
+    std::vector<std::unique_ptr<PooledSub>> &subs = m_subs[period];
+
+    for (auto it = subs.begin(); it != subs.end(); ++it)
+    {
+        if (it->get() == pooled)
+        {
+            try
+            {
+                pooled->sub->Delete();
+            }
+            catch (const std::exception &exc)
+            {
+                qDebug() << exc.what();
+            }
+
+            subs.erase(it);
+            break;
+        }
+    }
+
+    if (subs.empty())
+        m_subs.erase(period);
+}
+
+void OPCUASubPool::setMaxItemsPerSub(unsigned int maxitems)
+{
+    m_maxitems = maxitems > 0 ? maxitems : 1;
+}
+
+void OPCUASubPool::setMaxItemsPerCall(unsigned int maxpercall)
+{
+    m_maxpercall = maxpercall > 0 ? maxpercall : 1;
+}
+
+unsigned int OPCUASubPool::getMaxItemsPerSub() const
+{
+    return m_maxitems;
+}
+
+unsigned int OPCUASubPool::getMaxItemsPerCall() const
+{
+    return m_maxpercall;
+}
+
+size_t OPCUASubPool::getSubCount()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    size_t count = 0;
+    for (auto &pair : m_subs)
+        count += pair.second.size();
+
+    return count;
+}
+
+size_t OPCUASubPool::getItemCount()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    return m_items.size();
+}
@@ -0,0 +1,80 @@
+#ifndef OPCUASUBPOOL_H
+#define OPCUASUBPOOL_H
+
+#include <string>
+#include <map>
+#include <vector>
+#include <memory>
+#include <boost/thread.hpp>
+#include <opc/ua/client/client.h>
+#include <opc/ua/node.h>
+#include "opcuasubscription.h"
+
+class OPCUASubClient;
+class OPCUANodeRegistry;
+
+// --------------------------------------------------------
+// Result of a single link request, handle is 0 if it failed
+// --------------------------------------------------------
+struct OPCUALinkResult
+{
+    uint32_t handle;
+    OpcUa::StatusCode status;
+};
+
+// --------------------------------------------------------
+// OPCUASubPool class, shares server subscriptions between links
+// Every monitored item with the same publishing interval goes into
+// the same subscription, a new one is opened only when the item
+// limit of the existing ones has been reached. Items are created in
+// chunks of at most maxpercall items per CreateMonitoredItems call.
+// --------------------------------------------------------
+class OPCUASubPool
+{
+
+public:
+    OPCUASubPool(OpcUa::UaClient *client = nullptr, OPCUASubClient *handler = nullptr, OPCUANodeRegistry *registry = nullptr, unsigned int maxitems = 1000, unsigned int maxpercall = 1000);
+    ~OPCUASubPool();
+
+    uint32_t subscribe(const OpcUa::Node &node, const OPCUALinkOptions &options = OPCUALinkOptions());
+    std::vector<OPCUALinkResult> subscribe(const std::vector<OpcUa::Node> &nodes, const OPCUALinkOptions &options = OPCUALinkOptions());
+    void unsubscribe(const OpcUa::Node &node);
+    bool isSubscribed(const OpcUa::Node &node);
+    void clear();
+    void setMaxItemsPerSub(unsigned int maxitems);
+    void setMaxItemsPerCall(unsigned int maxpercall);
+    unsigned int getMaxItemsPerSub() const;
+    unsigned int getMaxItemsPerCall() const;
+    size_t getSubCount();
+    size_t getItemCount();
+
+private:
+    struct PooledSub
+    {
+        std::unique_ptr<OPCUASubscription> sub;
+        unsigned int period;
+        unsigned int items;
+    };
+
+    struct PooledItem
+    {
+        OpcUa::Node node;
+        PooledSub *owner;
+        uint32_t handle;
+    };
+
+    PooledSub *acquireSub(unsigned int period);
+    void releaseSub(PooledSub *pooled);
+
+    OpcUa::UaClient *m_client;
+    OPCUASubClient *m_handler;
+    OPCUANodeRegistry *m_registry;
+    unsigned int m_maxitems;
+    unsigned int m_maxpercall;
+    std::map<unsigned int, std::vector<std::unique_ptr<PooledSub>>> m_subs;
+    std::map<std::string, PooledItem> m_items;
+    boost::mutex m_mutex;
+
+};
+
+#endif // OPCUASUBPOOL_H
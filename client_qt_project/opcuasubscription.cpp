@@ -0,0 +1,149 @@
+#include "opcuasubscription.h"
+#include "opcuaclient.h"
+#include <QDebug>
+
+// --------------------------------------------------------
+// OPCUALinkOptions struct below
+// --------------------------------------------------------
+OPCUALinkOptions::OPCUALinkOptions() :
+    poll(false),
+    period(OPCUA_LINK_PERIOD),
+    samplinginterval(-1.0),
+    queuesize(OPCUA_LINK_QUEUE_SIZE),
+    discardoldest(true),
+    coalesce(true),
+    trigger(OpcUa::DataChangeTrigger::StatusValue),
+    deadband(OpcUa::DeadbandType::None),
+    deadbandvalue(0.0)
+{
+
+}
+
+bool OPCUALinkOptions::operator==(const OPCUALinkOptions &other) const
+{
+    return poll == other.poll && period == other.period && samplinginterval == other.samplinginterval
+            && queuesize == other.queuesize && discardoldest == other.discardoldest && coalesce == other.coalesce
+            && trigger == other.trigger && deadband == other.deadband && deadbandvalue == other.deadbandvalue;
+}
+
+bool OPCUALinkOptions::hasFilter() const
+{
+    return trigger != OpcUa::DataChangeTrigger::StatusValue || deadband != OpcUa::DeadbandType::None;
+}
+
+OpcUa::MonitoringFilter OPCUALinkOptions::getFilter() const
+{
+    if (!hasFilter())
+        return OpcUa::MonitoringFilter();
+
+    OpcUa::DataChangeFilter filter;
+    filter.Trigger = trigger;
+    filter.Deadband = deadband;
+    filter.DeadbandValue = deadband != OpcUa::DeadbandType::None ? deadbandvalue : 0.0;
+
+    return OpcUa::MonitoringFilter(filter);
+}
+
+// --------------------------------------------------------
+// OPCUASubscription class below
+// --------------------------------------------------------
+OPCUASubscription::OPCUASubscription(OpcUa::Services::SharedPtr server, const OpcUa::CreateSubscriptionParameters &params, OPCUASubClient &handler) :
+    OpcUa::Subscription(server, params, handler),
+    m_server(server),
+    m_handler(handler),
+    m_items(std::map<uint32_t, uint32_t>())
+{
+
+}
+
+std::vector<OpcUa::MonitoredItemCreateResult> OPCUASubscription::subscribeItems(const std::vector<OpcUa::Node> &nodes, const std::vector<uint32_t> &handles, const OPCUALinkOptions &options)
+{
+    // The server drops changes inside the deadband at the source
+    OpcUa::MonitoringFilter filter = options.getFilter();
+    double sampling = options.samplinginterval < 0.0 ? GetPeriode() : options.samplinginterval;
+    uint32_t queuesize = std::max<uint32_t>(options.queuesize, 1);
+
+    OpcUa::MonitoredItemsParameters params;
+    params.SubscriptionId = GetId();
+    params.TimestampsToReturn = OpcUa::TimestampsToReturn::Both;
+
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        OpcUa::MonitoredItemCreateRequest req;
+        req.ItemToMonitor.NodeId = nodes[i].GetId();
+        req.ItemToMonitor.AttributeId = OpcUa::AttributeId::Value;
+        req.MonitoringMode = OpcUa::MonitoringMode::Reporting;
+        req.RequestedParameters.ClientHandle = handles[i];
+        req.RequestedParameters.SamplingInterval = sampling;
+        req.RequestedParameters.QueueSize = queuesize;
+        req.RequestedParameters.DiscardOldest = options.discardoldest;
+        req.RequestedParameters.Filter = filter;
+        params.ItemsToCreate.push_back(req);
+    }
+
+    std::vector<OpcUa::MonitoredItemCreateResult> results = m_server->Subscriptions()->CreateMonitoredItems(params);
+
+    if (results.size() != nodes.size())
+        throw std::runtime_error("OPCUA: CreateMonitoredItems returned " + std::to_string(results.size()) + " results for " + std::to_string(nodes.size()) + " items.");
+
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        if (results[i].Status == OpcUa::StatusCode::Good)
+            m_items[handles[i]] = results[i].MonitoredItemId;
+    }
+
+    return results;
+}
+
+void OPCUASubscription::unsubscribeItem(uint32_t handle)
+{
+    uint32_t monitoreditemid = 0;
+
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+
+        auto it = m_items.find(handle);
+        if (it == m_items.end())
+            return;
+
+        monitoreditemid = it->second;
+        m_items.erase(it);
+    }
+
+    UnSubscribe(monitoreditemid);
+}
+
+size_t OPCUASubscription::getItemCount()
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    return m_items.size();
+}
+
+void OPCUASubscription::PublishCallback(OpcUa::Services::SharedPtr server, const OpcUa::PublishResult result)
+{
+    for (const OpcUa::NotificationData &data : result.NotificationMessage.NotificationData)
+    {
+        if (data.Header.TypeId == OpcUa::ExpandedObjectId::DataChangeNotification)
+        {
+            for (const OpcUa::MonitoredItems &item : data.DataChange.Notification)
+                m_handler.dataValueChange(item.ClientHandle, item.Value);
+        }
+        else if (data.Header.TypeId == OpcUa::ExpandedObjectId::StatusChangeNotification)
+        {
+            m_handler.StatusChange(data.StatusChange.Status);
+        }
+    }
+
+    m_handler.dataChangesDone();
+
+    // Acknowledge the notification and keep the publish loop going
+    OpcUa::SubscriptionAcknowledgement ack;
+    ack.SubscriptionId = GetId();
+    ack.SequenceNumber = result.NotificationMessage.SequenceNumber;
+    OpcUa::PublishRequest request;
+    request.SubscriptionAcknowledgements.push_back(ack);
+    server->Subscriptions()->Publish(request);
+}
@@ -0,0 +1,67 @@
+#ifndef OPCUASUBSCRIPTION_H
+#define OPCUASUBSCRIPTION_H
+
+#include <algorithm>
+#include <map>
+#include <vector>
+#include <boost/thread.hpp>
+#include <opc/ua/node.h>
+#include <opc/ua/subscription.h>
+#include "config.h"
+
+class OPCUASubClient;
+
+// --------------------------------------------------------
+// Per link monitored item settings
+// The default, StatusValue without deadband, sends no filter at all.
+// A negative sampling interval samples at the publishing interval, a queue
+// size above 1 keeps the changes sampled between two publishes. Event links
+// turn coalesce off so a slow broker doesn't cost them any samples.
+// Polled links are read every period instead, the monitored item
+// settings don't apply to them.
+// --------------------------------------------------------
+struct OPCUALinkOptions
+{
+    bool poll;
+    unsigned int period;
+    double samplinginterval;
+    uint32_t queuesize;
+    bool discardoldest;
+    bool coalesce;
+    OpcUa::DataChangeTrigger trigger;
+    OpcUa::DeadbandType deadband;
+    double deadbandvalue;
+
+    OPCUALinkOptions();
+    bool operator==(const OPCUALinkOptions &other) const;
+    bool hasFilter() const;
+    OpcUa::MonitoringFilter getFilter() const;
+};
+
+// --------------------------------------------------------
+// OPCUASubscription class, subscription with caller chosen client handles
+// Monitored items are created in bulk with MonitoredItemCreateRequests and
+// the per-item results are returned to the caller. Notifications are passed
+// to the sub client by client handle only, it holds the link metadata.
+// --------------------------------------------------------
+class OPCUASubscription : public OpcUa::Subscription
+{
+
+public:
+    OPCUASubscription(OpcUa::Services::SharedPtr server, const OpcUa::CreateSubscriptionParameters &params, OPCUASubClient &handler);
+
+    std::vector<OpcUa::MonitoredItemCreateResult> subscribeItems(const std::vector<OpcUa::Node> &nodes, const std::vector<uint32_t> &handles, const OPCUALinkOptions &options);
+    void unsubscribeItem(uint32_t handle);
+    size_t getItemCount();
+
+    virtual void PublishCallback(OpcUa::Services::SharedPtr server, const OpcUa::PublishResult result) override;
+
+private:
+    OpcUa::Services::SharedPtr m_server;
+    OPCUASubClient &m_handler;
+    std::map<uint32_t, uint32_t> m_items; // client handle -> monitored item id
+    boost::mutex m_mutex;
+
+};
+
+#endif // OPCUASUBSCRIPTION_H
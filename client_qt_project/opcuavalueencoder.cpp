@@ -0,0 +1,521 @@
+#include "opcuavalueencoder.h"
+#include <opc/ua/protocol/variant_visitor.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+
+const char s_digits2[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+const char s_hex[] = "0123456789abcdef";
+
+// --------------------------------------------------------
+// Writer, bounded output into the caller buffer
+// --------------------------------------------------------
+struct Writer
+{
+    char *buf;
+    size_t size;
+    size_t len;
+    bool overflow;
+
+    void put(char c)
+    {
+        if (len < size)
+            buf[len++] = c;
+        else
+            overflow = true;
+    }
+
+    void put(const char *s, size_t n)
+    {
+        if (len + n <= size)
+        {
+            std::memcpy(buf + len, s, n);
+            len += n;
+        }
+        else
+        {
+            overflow = true;
+        }
+    }
+
+    void putUInt(uint64_t v)
+    {
+        char tmp[20];
+        char *p = tmp + sizeof(tmp);
+
+        while (v >= 100)
+        {
+            unsigned int i = (unsigned int) (v % 100) * 2;
+            v /= 100;
+            *--p = s_digits2[i + 1];
+            *--p = s_digits2[i];
+        }
+
+        if (v >= 10)
+        {
+            unsigned int i = (unsigned int) v * 2;
+            *--p = s_digits2[i + 1];
+            *--p = s_digits2[i];
+        }
+        else
+        {
+            *--p = (char) ('0' + v);
+        }
+
+        put(p, (size_t) (tmp + sizeof(tmp) - p));
+    }
+
+    void putInt(int64_t v)
+    {
+        if (v < 0)
+        {
+            put('-');
+            putUInt(0 - (uint64_t) v);
+        }
+        else
+        {
+            putUInt((uint64_t) v);
+        }
+    }
+
+    void putFixed(unsigned int v, int width)
+    {
+        char tmp[10];
+        for (int i = width - 1; i >= 0; i--)
+        {
+            tmp[i] = (char) ('0' + v % 10);
+            v /= 10;
+        }
+
+        put(tmp, (size_t) width);
+    }
+
+    void putHex(uint64_t v, int width)
+    {
+        char tmp[16];
+        for (int i = width - 1; i >= 0; i--)
+        {
+            tmp[i] = s_hex[v & 0xF];
+            v >>= 4;
+        }
+
+        put(tmp, (size_t) width);
+    }
+
+    // Shortest of the printf precisions that reads back to the same value
+    void putDouble(double v, int minprec, int maxprec, bool single, bool quoted)
+    {
+        // NaN & infinities have no JSON number form, JSON gets null, a plain payload the bare token
+        if (std::isnan(v) || std::isinf(v))
+        {
+            if (quoted)
+                put("null", 4);
+            else if (std::isnan(v))
+                put("NaN", 3);
+            else
+                put(v < 0 ? "-Infinity" : "Infinity", v < 0 ? 9 : 8);
+
+            return;
+        }
+
+        char tmp[32];
+        int n = 0;
+        for (int prec = minprec; prec <= maxprec; prec++)
+        {
+            n = std::snprintf(tmp, sizeof(tmp), "%.*g", prec, v);
+
+            if (single ? (std::strtof(tmp, nullptr) == (float) v) : (std::strtod(tmp, nullptr) == v))
+                break;
+        }
+
+        put(tmp, (size_t) n);
+    }
+
+    void putString(const std::string &s, bool quoted)
+    {
+        if (!quoted)
+        {
+            put(s.data(), s.size());
+            return;
+        }
+
+        put('"');
+        putEscaped(s);
+        put('"');
+    }
+
+    // JSON string escapes without the quotes, for text inside a quoted value
+    void putEscaped(const std::string &s)
+    {
+        for (char c : s)
+        {
+            switch (c)
+            {
+            case '"': put("\\\"", 2); break;
+            case '\\': put("\\\\", 2); break;
+            case '\n': put("\\n", 2); break;
+            case '\r': put("\\r", 2); break;
+            case '\t': put("\\t", 2); break;
+            default:
+                if ((unsigned char) c < 0x20)
+                {
+                    put("\\u00", 4);
+                    putHex((unsigned char) c, 2);
+                }
+                else
+                {
+                    put(c);
+                }
+                break;
+            }
+        }
+    }
+};
+
+// --------------------------------------------------------
+// Encoder, one overload per variant type
+// --------------------------------------------------------
+class Encoder
+{
+
+public:
+    Encoder(Writer &out, bool quoted) : m_out(out), m_quoted(quoted) {}
+
+    void OnScalar(bool v) { if (v) m_out.put("true", 4); else m_out.put("false", 5); }
+    void OnScalar(int8_t v) { m_out.putInt(v); }
+    void OnScalar(uint8_t v) { m_out.putUInt(v); }
+    void OnScalar(int16_t v) { m_out.putInt(v); }
+    void OnScalar(uint16_t v) { m_out.putUInt(v); }
+    void OnScalar(int32_t v) { m_out.putInt(v); }
+    void OnScalar(uint32_t v) { m_out.putUInt(v); }
+    void OnScalar(int64_t v) { m_out.putInt(v); }
+    void OnScalar(uint64_t v) { m_out.putUInt(v); }
+    void OnScalar(float v) { m_out.putDouble(v, 6, 9, true, m_quoted); }
+    void OnScalar(double v) { m_out.putDouble(v, 15, 17, false, m_quoted); }
+    void OnScalar(const std::string &v) { m_out.putString(v, m_quoted); }
+
+    void OnScalar(const OpcUa::DateTime &v)
+    {
+        if (m_quoted)
+            m_out.put('"');
+
+        char tmp[32];
+        int n = OPCUAValueEncoder::encodeDateTime(v, tmp, sizeof(tmp));
+        if (n > 0)
+            m_out.put(tmp, (size_t) n);
+
+        if (m_quoted)
+            m_out.put('"');
+    }
+
+    void OnScalar(const OpcUa::Guid &v)
+    {
+        if (m_quoted)
+            m_out.put('"');
+
+        putGuid(v);
+
+        if (m_quoted)
+            m_out.put('"');
+    }
+
+    void OnScalar(const OpcUa::ByteString &v)
+    {
+        if (m_quoted)
+            m_out.put('"');
+
+        for (uint8_t b : v.Data)
+            m_out.putHex(b, 2);
+
+        if (m_quoted)
+            m_out.put('"');
+    }
+
+    void OnScalar(const OpcUa::NodeId &v)
+    {
+        if (m_quoted)
+            m_out.put('"');
+
+        m_out.put("ns=", 3);
+        m_out.putUInt(v.GetNamespaceIndex());
+
+        if (v.IsInteger())
+        {
+            m_out.put(";i=", 3);
+            m_out.putUInt(v.GetIntegerIdentifier());
+        }
+        else if (v.IsString())
+        {
+            m_out.put(";s=", 3);
+            if (m_quoted)
+                m_out.putEscaped(v.StringData.Identifier);
+            else
+                m_out.put(v.StringData.Identifier.data(), v.StringData.Identifier.size());
+        }
+        else if (v.IsGuid())
+        {
+            m_out.put(";g=", 3);
+            putGuid(v.GuidData.Identifier);
+        }
+        else if (v.IsBinary())
+        {
+            m_out.put(";b=", 3);
+            for (uint8_t b : v.BinaryData.Identifier)
+                m_out.putHex(b, 2);
+        }
+
+        if (m_quoted)
+            m_out.put('"');
+    }
+
+    void OnScalar(const OpcUa::StatusCode &v)
+    {
+        if (m_quoted)
+            m_out.put('"');
+
+        m_out.put("0x", 2);
+        m_out.putHex((uint32_t) v, 8);
+
+        if (m_quoted)
+            m_out.put('"');
+    }
+
+    void OnScalar(const OpcUa::LocalizedText &v)
+    {
+        m_out.putString(v.Text, m_quoted);
+    }
+
+    void OnScalar(const OpcUa::QualifiedName &v)
+    {
+        if (m_quoted)
+            m_out.put('"');
+
+        m_out.putUInt(v.NamespaceIndex);
+        m_out.put(':');
+        if (m_quoted)
+            m_out.putEscaped(v.Name);
+        else
+            m_out.putString(v.Name, false);
+
+        if (m_quoted)
+            m_out.put('"');
+    }
+
+    void OnScalar(const OpcUa::Variant &v)
+    {
+        if (v.IsNul())
+        {
+            m_out.put("null", 4);
+            return;
+        }
+
+        OpcUa::TypedVisitor<Encoder> visitor(*this);
+        v.Visit(visitor);
+    }
+
+    void OnScalar(const OpcUa::DiagnosticInfo &)
+    {
+        m_out.put("null", 4);
+    }
+
+    template <typename T>
+    void OnContainer(const std::vector<T> &v)
+    {
+        // Elements of an array are always quoted, the result is a JSON array
+        bool quoted = m_quoted;
+        m_quoted = true;
+
+        m_out.put('[');
+        for (size_t i = 0; i < v.size() && !m_out.overflow; i++)
+        {
+            if (i > 0)
+                m_out.put(',');
+
+            OnScalar(static_cast<const T &>(v[i]));
+        }
+        m_out.put(']');
+
+        m_quoted = quoted;
+    }
+
+    void OnContainer(const std::vector<bool> &v)
+    {
+        m_out.put('[');
+        for (size_t i = 0; i < v.size() && !m_out.overflow; i++)
+        {
+            if (i > 0)
+                m_out.put(',');
+
+            OnScalar(static_cast<bool>(v[i]));
+        }
+        m_out.put(']');
+    }
+
+private:
+    void putGuid(const OpcUa::Guid &v)
+    {
+        m_out.putHex(v.Data1, 8);
+        m_out.put('-');
+        m_out.putHex(v.Data2, 4);
+        m_out.put('-');
+        m_out.putHex(v.Data3, 4);
+        m_out.put('-');
+        m_out.putHex(v.Data4[0], 2);
+        m_out.putHex(v.Data4[1], 2);
+        m_out.put('-');
+        for (int i = 2; i < 8; i++)
+            m_out.putHex(v.Data4[i], 2);
+    }
+
+    Writer &m_out;
+    bool m_quoted;
+
+};
+
+}
+
+// --------------------------------------------------------
+// OPCUAValueEncoder class below
+// --------------------------------------------------------
+int OPCUAValueEncoder::encode(const OpcUa::Variant &val, char *buf, size_t size, bool quoted)
+{
+    Writer out;
+    out.buf = buf;
+    out.size = size;
+    out.len = 0;
+    out.overflow = false;
+
+    Encoder encoder(out, quoted);
+    encoder.OnScalar(val);
+
+    return out.overflow ? -1 : (int) out.len;
+}
+
+int OPCUAValueEncoder::encodeDataValue(const OpcUa::DataValue &val, char *buf, size_t size)
+{
+    Writer out;
+    out.buf = buf;
+    out.size = size;
+    out.len = 0;
+    out.overflow = false;
+
+    out.put("{\"value\":", 9);
+    Encoder encoder(out, true);
+    encoder.OnScalar(val.Value);
+
+    // Severity is in the two topmost bits of the status code
+    uint32_t status = (uint32_t) val.Status;
+    out.put(",\"quality\":", 11);
+    if ((status & 0xC0000000) == 0)
+        out.put("\"Good\"", 6);
+    else if ((status & 0xC0000000) == 0x40000000)
+        out.put("\"Uncertain\"", 11);
+    else
+        out.put("\"Bad\"", 5);
+
+    out.put(",\"status\":", 10);
+    encoder.OnScalar(val.Status);
+
+    // Fall back to the server timestamp if the source didn't give one
+    const OpcUa::DateTime &ts = val.SourceTimestamp.Value != 0 ? val.SourceTimestamp : val.ServerTimestamp;
+    if (ts.Value != 0)
+    {
+        out.put(",\"ts\":", 6);
+        encoder.OnScalar(ts);
+    }
+
+    out.put('}');
+
+    return out.overflow ? -1 : (int) out.len;
+}
+
+int OPCUAValueEncoder::encodeDateTime(const OpcUa::DateTime &dt, char *buf, size_t size)
+{
+    // DateTime counts 100 ns ticks since 1601-01-01, shift to the unix epoch
+    const int64_t epochdiff = 116444736000000000LL;
+    int64_t ticks = dt.Value - epochdiff;
+    int64_t secs = ticks / 10000000;
+    int64_t frac = ticks % 10000000;
+    if (frac < 0)
+    {
+        frac += 10000000;
+        secs--;
+    }
+
+    int64_t days = secs / 86400;
+    int64_t rem = secs % 86400;
+    if (rem < 0)
+    {
+        rem += 86400;
+        days--;
+    }
+
+    // Consecutive values are almost always from the same day, so the
+    // "YYYY-MM-DDT" prefix is cached per thread and only the time is formatted
+    static thread_local int64_t cachedday = INT64_MIN;
+    static thread_local char cachedprefix[11];
+
+    if (days != cachedday)
+    {
+        // Civil date from days since epoch (H. Hinnant's algorithm)
+        int64_t z = days + 719468;
+        int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+        unsigned int doe = (unsigned int) (z - era * 146097);
+        unsigned int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        int64_t y = (int64_t) yoe + era * 400;
+        unsigned int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        unsigned int mp = (5 * doy + 2) / 153;
+        unsigned int d = doy - (153 * mp + 2) / 5 + 1;
+        unsigned int m = mp < 10 ? mp + 3 : mp - 9;
+        if (m <= 2)
+            y++;
+
+        Writer prefix;
+        prefix.buf = cachedprefix;
+        prefix.size = sizeof(cachedprefix);
+        prefix.len = 0;
+        prefix.overflow = false;
+
+        prefix.putFixed((unsigned int) y, 4);
+        prefix.put('-');
+        prefix.putFixed(m, 2);
+        prefix.put('-');
+        prefix.putFixed(d, 2);
+        prefix.put('T');
+
+        cachedday = days;
+    }
+
+    Writer out;
+    out.buf = buf;
+    out.size = size;
+    out.len = 0;
+    out.overflow = false;
+
+    out.put(cachedprefix, sizeof(cachedprefix));
+    out.putFixed((unsigned int) (rem / 3600), 2);
+    out.put(':');
+    out.putFixed((unsigned int) (rem / 60 % 60), 2);
+    out.put(':');
+    out.putFixed((unsigned int) (rem % 60), 2);
+    out.put('.');
+    out.putFixed((unsigned int) (frac / 10000), 3);
+    out.put('Z');
+
+    return out.overflow ? -1 : (int) out.len;
+}
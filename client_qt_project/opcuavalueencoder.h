@@ -0,0 +1,30 @@
+#ifndef OPCUAVALUEENCODER_H
+#define OPCUAVALUEENCODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <opc/ua/protocol/variant.h>
+#include <opc/ua/protocol/datetime.h>
+#include <opc/ua/protocol/data_value.h>
+
+// --------------------------------------------------------
+// OPCUAValueEncoder class, writes variant values as text into a caller buffer
+// Every VariantType has its own encode overload, picked at compile time by
+// the TypedVisitor, so no stream formatting and no heap allocation happens.
+// Strings are quoted & escaped when quoted is set, arrays are written as
+// JSON arrays. NaN & infinities are null when quoted, as JSON has no
+// number for them. encodeDataValue writes a JSON object with value, quality,
+// status code & source timestamp. encodeDateTime writes ISO 8601 in UTC.
+// Returns the length written, or -1 if the buffer was too small.
+// --------------------------------------------------------
+class OPCUAValueEncoder
+{
+
+public:
+    static int encode(const OpcUa::Variant &val, char *buf, size_t size, bool quoted = false);
+    static int encodeDataValue(const OpcUa::DataValue &val, char *buf, size_t size);
+    static int encodeDateTime(const OpcUa::DateTime &dt, char *buf, size_t size);
+
+};
+
+#endif // OPCUAVALUEENCODER_H